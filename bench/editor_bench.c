@@ -0,0 +1,253 @@
+// Throughput of the editor operations (insert, newline, backspace, delete)
+// under three workloads on documents from 1 KiB up to `max_bytes`:
+//   typing  keystrokes at one spot, Enter every line, then erased again
+//   paste   multi-line blocks inserted at random rows
+//   random  a random operation at a random position
+// Every document is written to a temporary file and opened the way ted
+// opens files, so the lazily loaded rows are part of what is measured.
+// Results go to stdout as CSV, one row per workload, size and operation.
+// Usage: bench_editor [max_bytes] [ops]
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../editor.h"
+
+#define DEFAULT_MAX_BYTES (1024ULL * 1024 * 1024)
+#define DEFAULT_OPS 200000
+#define MIN_BYTES 1024
+#define SIZE_STEP 32
+#define TYPING_LINE 64
+#define PASTE_LINES 32
+
+typedef enum {
+    OP_INSERT = 0,
+    OP_NEWLINE,
+    OP_BACKSPACE,
+    OP_DELETE,
+    COUNT_OPS,
+} Op;
+
+static const char *op_names[COUNT_OPS] = {
+    [OP_INSERT]    = "insert",
+    [OP_NEWLINE]   = "newline",
+    [OP_BACKSPACE] = "backspace",
+    [OP_DELETE]    = "delete",
+};
+
+typedef struct {
+    size_t count[COUNT_OPS];
+    double ns[COUNT_OPS];
+} Op_Times;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Cost of reading the clock, taken off every timed operation
+static double timer_overhead_ns = 0.0;
+
+static void timer_calibrate(void)
+{
+    const size_t n = 100000;
+    const double start = now_ns();
+    for (size_t i = 0; i < n; ++i) {
+        now_ns();
+    }
+    timer_overhead_ns = (now_ns() - start) / n;
+}
+
+static uint32_t rng_state = 0x12345678;
+
+static size_t rng(size_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return n ? rng_state % n : 0;
+}
+
+static void op_run(Op_Times *times, Editor *editor, Op op, const char *text)
+{
+    const double start = now_ns();
+    switch (op) {
+    case OP_INSERT:    editor_insert_text_before_cursor(editor, text); break;
+    case OP_NEWLINE:   editor_insert_new_line(editor);                  break;
+    case OP_BACKSPACE: editor_backspace(editor);                        break;
+    case OP_DELETE:    editor_delete(editor);                           break;
+    default:           break;
+    }
+    const double elapsed = now_ns() - start - timer_overhead_ns;
+    times->ns[op] += elapsed > 0.0 ? elapsed : 0.0;
+    times->count[op] += 1;
+}
+
+static void cursor_to_random(Editor *editor)
+{
+    editor->cursor_row = rng(editor_rows(editor));
+    const Line line = editor_peek_line(editor, editor->cursor_row);
+    editor->cursor_col = rng(line.size + 1);
+}
+
+// Roughly 40 bytes per line of lowercase words, like source code or prose
+static void write_document(const char *path, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not create %s\n", path);
+        exit(1);
+    }
+
+    char chunk[64 * 1024];
+    uint32_t state = 42;
+    size_t written = 0;
+    while (written < size) {
+        size_t n = size - written < sizeof(chunk) ? size - written : sizeof(chunk);
+        for (size_t i = 0; i < n; ++i) {
+            state = state * 1103515245 + 12345;
+            const uint32_t r = state >> 16;
+            chunk[i] = r % 40 == 0 ? '\n' : r % 6 == 0 ? ' ' : 'a' + r % 26;
+        }
+        if (fwrite(chunk, 1, n, f) != n) {
+            fprintf(stderr, "ERROR: could not write %s\n", path);
+            exit(1);
+        }
+        written += n;
+    }
+    fclose(f);
+}
+
+static void open_document(Editor *editor, const char *path)
+{
+    if (!editor_open_file(editor, path)) {
+        fprintf(stderr, "ERROR: could not open %s\n", path);
+        exit(1);
+    }
+
+    const struct timespec pause = {0, 1000000};
+    while (editor_loading(editor)) {
+        editor_poll_load(editor);
+        nanosleep(&pause, NULL);
+    }
+    while (editor_poll_load(editor)) {}
+}
+
+static void workload_typing(Editor *editor, size_t ops, Op_Times *times)
+{
+    cursor_to_random(editor);
+    for (size_t i = 0; i < ops; ++i) {
+        if ((i + 1) % TYPING_LINE == 0) {
+            op_run(times, editor, OP_NEWLINE, NULL);
+        } else {
+            const char c[2] = {'a' + i % 26, '\0'};
+            op_run(times, editor, OP_INSERT, c);
+        }
+    }
+    for (size_t i = 0; i < ops; ++i) {
+        op_run(times, editor, OP_BACKSPACE, NULL);
+    }
+
+    // Forward delete eats into the original rows after the cursor
+    cursor_to_random(editor);
+    for (size_t i = 0; i < ops && editor_rows(editor) > 1; ++i) {
+        op_run(times, editor, OP_DELETE, NULL);
+    }
+}
+
+static void workload_paste(Editor *editor, size_t ops, Op_Times *times)
+{
+    char line[TYPING_LINE + 1];
+    for (size_t i = 0; i < TYPING_LINE; ++i) {
+        line[i] = 'a' + i % 26;
+    }
+    line[TYPING_LINE] = '\0';
+
+    // A paste of PASTE_LINES lines is one insert per line and a newline
+    // between them, which is how the clipboard text enters the editor
+    for (size_t done = 0; done < ops; done += 2 * PASTE_LINES) {
+        cursor_to_random(editor);
+        for (size_t i = 0; i < PASTE_LINES; ++i) {
+            op_run(times, editor, OP_INSERT, line);
+            op_run(times, editor, OP_NEWLINE, NULL);
+        }
+    }
+}
+
+static void workload_random(Editor *editor, size_t ops, Op_Times *times)
+{
+    for (size_t i = 0; i < ops; ++i) {
+        cursor_to_random(editor);
+        const Op op = rng(COUNT_OPS);
+        op_run(times, editor, op, op == OP_INSERT ? "x" : NULL);
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(Editor *editor, size_t ops, Op_Times *times);
+} Workload;
+
+static const Workload workloads[] = {
+    {"typing", workload_typing},
+    {"paste",  workload_paste},
+    {"random", workload_random},
+};
+
+static void bench(const char *path, size_t size, size_t ops)
+{
+    write_document(path, size);
+
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w) {
+        // Every workload starts from the untouched document
+        Editor editor = {0};
+        const double open_start = now_ns();
+        open_document(&editor, path);
+        const double open_ms = (now_ns() - open_start) / 1e6;
+        const size_t rows = editor_rows(&editor);
+
+        Op_Times times = {0};
+        workloads[w].run(&editor, ops, &times);
+
+        for (Op op = 0; op < COUNT_OPS; ++op) {
+            if (times.count[op] == 0) continue;
+            const double ns_per_op = times.ns[op] / times.count[op];
+            printf("%s,%zu,%zu,%s,%zu,%.1f,%.0f,%.1f\n",
+                   workloads[w].name, size, rows, op_names[op], times.count[op],
+                   ns_per_op, ns_per_op > 0.0 ? 1e9 / ns_per_op : 0.0, open_ms);
+        }
+        fflush(stdout);
+
+        editor_free(&editor);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t max_bytes = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_MAX_BYTES;
+    const size_t ops = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_OPS;
+
+    const char *tmpdir = getenv("TMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/bench_editor.XXXXXX", tmpdir ? tmpdir : "/tmp");
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not create a temporary file in %s\n", tmpdir ? tmpdir : "/tmp");
+        return 1;
+    }
+    close(fd);
+
+    timer_calibrate();
+    printf("workload,doc_bytes,doc_rows,op,count,ns_per_op,ops_per_sec,open_ms\n");
+    for (size_t size = MIN_BYTES; size <= max_bytes; size *= SIZE_STEP) {
+        fprintf(stderr, "%zu bytes...\n", size);
+        bench(path, size, ops);
+    }
+
+    unlink(path);
+    return 0;
+}
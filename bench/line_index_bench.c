@@ -0,0 +1,104 @@
+// Row lookup/insert/delete latency of the piece table from 10K to 10M lines.
+// Every operation is O(log pieces), but the larger documents no longer fit
+// in cache, so expect the times to grow with size rather than stay flat.
+// Usage: bench_line_index [max_lines] [ops]
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../piece_table.h"
+
+#define DEFAULT_MAX_LINES 10000000
+#define DEFAULT_OPS 200000
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint32_t rng_state = 0x12345678;
+
+static size_t rng(size_t n)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % n;
+}
+
+static char *make_text(size_t lines, size_t *size)
+{
+    char *text = malloc(lines * 16);
+    if (text == NULL) {
+        fprintf(stderr, "ERROR: could not allocate text for %zu lines\n", lines);
+        exit(1);
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < lines; ++i) {
+        n += sprintf(text + n, "line %zu\n", i % 10000000);
+    }
+    *size = n;
+    return text;
+}
+
+static void bench(size_t lines, size_t ops)
+{
+    size_t text_size = 0;
+    char *text = make_text(lines, &text_size);
+    Piece_Table pt = {0};
+    piece_table_load(&pt, text, text_size);
+
+    volatile size_t sink = 0;
+
+    double start = now_ns();
+    for (size_t i = 0; i < ops; ++i) {
+        const size_t row = rng(piece_table_rows(&pt) + 1);
+        Line *line = piece_table_insert_line(&pt, row);
+        size_t col = 0;
+        line_insert_text_before(line, "inserted", &col);
+        piece_table_update_line(&pt, row);
+    }
+    const double insert_ns = (now_ns() - start) / ops;
+
+    start = now_ns();
+    for (size_t i = 0; i < ops; ++i) {
+        const Line line = piece_table_peek_line(&pt, rng(piece_table_rows(&pt)));
+        sink += line.size;
+    }
+    const double lookup_ns = (now_ns() - start) / ops;
+
+    start = now_ns();
+    for (size_t i = 0; i < ops; ++i) {
+        sink += piece_table_row_at_byte(&pt, rng(piece_table_bytes(&pt)));
+    }
+    const double byte_ns = (now_ns() - start) / ops;
+
+    start = now_ns();
+    for (size_t i = 0; i < ops; ++i) {
+        piece_table_delete_line(&pt, rng(piece_table_rows(&pt)));
+    }
+    const double delete_ns = (now_ns() - start) / ops;
+
+    printf("%10zu lines: insert %8.1f ns  lookup %8.1f ns  byte->row %8.1f ns  delete %8.1f ns\n",
+           lines, insert_ns, lookup_ns, byte_ns, delete_ns);
+    (void) sink;
+
+    piece_table_free(&pt);
+    free(text);
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t max_lines = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_MAX_LINES;
+    const size_t ops = argc > 2 ? strtoull(argv[2], NULL, 10) : DEFAULT_OPS;
+
+    for (size_t lines = 10000; lines <= max_lines; lines *= 10) {
+        bench(lines, ops);
+    }
+
+    return 0;
+}
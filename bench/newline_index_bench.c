@@ -0,0 +1,127 @@
+// Newline indexing throughput of every supported scanner against a plain
+// memchr loop, for short, medium and long lines, then of the parallel
+// indexer with 2, 4, ... threads up to the number of cores.
+// Usage: bench_newline_index [megabytes]
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../newline_index.h"
+
+#define DEFAULT_MEGABYTES 256
+#define RUNS 5
+
+static double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static char *make_text(size_t size, size_t average_line)
+{
+    char *text = malloc(size);
+    if (text == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes\n", size);
+        exit(1);
+    }
+
+    srand(42);
+    for (size_t i = 0; i < size; ++i) {
+        text[i] = rand() % average_line == 0 ? '\n' : 'a' + rand() % 26;
+    }
+    return text;
+}
+
+static size_t *memchr_index(const char *text, size_t text_size, size_t *count)
+{
+    size_t capacity = 1024;
+    size_t n = 0;
+    size_t *starts = malloc(capacity * sizeof(starts[0]));
+    starts[n++] = 0;
+
+    const char *p = text;
+    const char *end = text + text_size;
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        p += 1;
+        if (n + 1 >= capacity) {
+            capacity *= 2;
+            starts = realloc(starts, capacity * sizeof(starts[0]));
+        }
+        starts[n++] = p - text;
+    }
+    if (starts[n - 1] != text_size) {
+        starts[n++] = text_size;
+    }
+
+    *count = n - 1;
+    return starts;
+}
+
+static void report(const char *name, const char *text, size_t text_size,
+                   size_t *(*index)(Newline_Scanner, const char *, size_t, size_t *),
+                   Newline_Scanner scanner, const size_t *expected, size_t expected_count)
+{
+    double best = 1e9;
+    for (size_t run = 0; run < RUNS; ++run) {
+        size_t count = 0;
+        const double start = now_secs();
+        size_t *starts = index(scanner, text, text_size, &count);
+        const double elapsed = now_secs() - start;
+        if (elapsed < best) best = elapsed;
+
+        if (count != expected_count || memcmp(starts, expected, (count + 1) * sizeof(starts[0])) != 0) {
+            fprintf(stderr, "ERROR: %s produced a different index\n", name);
+            exit(1);
+        }
+        free(starts);
+    }
+
+    printf("  %-8s %7.2f GB/s\n", name, text_size / best / 1e9);
+}
+
+static size_t *memchr_index_with(Newline_Scanner scanner, const char *text, size_t text_size, size_t *count)
+{
+    (void) scanner;
+    return memchr_index(text, text_size, count);
+}
+
+static size_t parallel_threads = 1;
+
+static size_t *parallel_index_with(Newline_Scanner scanner, const char *text, size_t text_size, size_t *count)
+{
+    return newline_index_parallel(scanner, text, text_size, parallel_threads, count);
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t megabytes = argc > 1 ? strtoull(argv[1], NULL, 10) : DEFAULT_MEGABYTES;
+    const size_t text_size = megabytes * 1024 * 1024;
+    const size_t line_lengths[] = {8, 40, 200};
+
+    for (size_t i = 0; i < sizeof(line_lengths) / sizeof(line_lengths[0]); ++i) {
+        char *text = make_text(text_size, line_lengths[i]);
+        size_t expected_count = 0;
+        size_t *expected = memchr_index(text, text_size, &expected_count);
+
+        printf("%zu MiB, ~%zu bytes per line, %zu lines\n", megabytes, line_lengths[i], expected_count);
+        report("memchr", text, text_size, memchr_index_with, NEWLINE_SCANNER_AUTO, expected, expected_count);
+        for (Newline_Scanner scanner = NEWLINE_SCANNER_SCALAR; scanner < COUNT_NEWLINE_SCANNERS; ++scanner) {
+            if (newline_scanner_supported(scanner)) {
+                report(newline_scanner_name(scanner), text, text_size, newline_index_with, scanner, expected, expected_count);
+            }
+        }
+        const size_t cores = newline_index_default_threads();
+        for (parallel_threads = 2; parallel_threads <= (cores > 2 ? cores : 2); parallel_threads *= 2) {
+            char name[32];
+            snprintf(name, sizeof(name), "auto x%zu", parallel_threads);
+            report(name, text, text_size, parallel_index_with, NEWLINE_SCANNER_AUTO, expected, expected_count);
+        }
+
+        free(expected);
+        free(text);
+    }
+
+    return 0;
+}
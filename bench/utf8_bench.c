@@ -0,0 +1,218 @@
+// UTF-8 validation and character counting throughput on ASCII, Latin and
+// CJK text, then random column lookups on one long CJK row through its
+// column index against a plain scan from the start of the row, and
+// edits to that row each followed by a lookup.
+// Usage: bench_utf8 [megabytes]
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../utf8.h"
+#include "../line.h"
+#include "../column_index.h"
+
+#define DEFAULT_MEGABYTES 256
+#define RUNS 5
+#define ROW_BYTES (1024 * 1024)
+#define LOOKUPS 100000
+#define EDITS 10000
+
+static double now_secs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// One in `other` characters is `sample`, the rest are ASCII letters
+static char *make_text(size_t size, const char *sample, size_t other)
+{
+    char *text = malloc(size);
+    if (text == NULL) {
+        fprintf(stderr, "ERROR: could not allocate %zu bytes\n", size);
+        exit(1);
+    }
+
+    srand(42);
+    const size_t n = strlen(sample);
+    size_t i = 0;
+    while (i + n <= size) {
+        if (rand() % other == 0) {
+            memcpy(text + i, sample, n);
+            i += n;
+        } else {
+            text[i++] = rand() % 64 == 0 ? '\n' : 'a' + rand() % 26;
+        }
+    }
+    while (i < size) text[i++] = 'a';
+    return text;
+}
+
+static void report(const char *name, const char *text, size_t size)
+{
+    double validate = 1e9;
+    double count = 1e9;
+    size_t errors = 0;
+    size_t chars = 0;
+    for (size_t run = 0; run < RUNS; ++run) {
+        size_t first_error = 0;
+        double start = now_secs();
+        errors = utf8_validate(text, size, &first_error);
+        double elapsed = now_secs() - start;
+        if (elapsed < validate) validate = elapsed;
+
+        start = now_secs();
+        size_t run = UTF8_MAX_CONTINUATIONS;
+        chars = utf8_count_starts(text, size, &run);
+        elapsed = now_secs() - start;
+        if (elapsed < count) count = elapsed;
+    }
+    if (errors != 0) {
+        fprintf(stderr, "ERROR: %s text did not validate\n", name);
+        exit(1);
+    }
+    printf("%-6s %10zu chars  validate %7.2f GB/s  count %7.2f GB/s\n",
+           name, chars, size / validate / 1e9, size / count / 1e9);
+}
+
+static size_t scan_to_column(const Line *line, size_t column)
+{
+    size_t col = 0;
+    for (; column > 0 && col < line->size; --column) {
+        col = line_next_col(line, col);
+    }
+    return col;
+}
+
+static void report_lookups(void)
+{
+    char *text = make_text(ROW_BYTES, "\xe6\xbc\xa2", 1);
+    for (size_t i = 0; i < ROW_BYTES; ++i) {
+        if (text[i] == '\n') text[i] = ' ';
+    }
+    const Line line = line_view(text, ROW_BYTES);
+    static Column_Cache cache = {0};
+
+    double start = now_secs();
+    const Column_Index *index = column_cache_get(&cache, 0, 0, &line);
+    const double build = now_secs() - start;
+
+    size_t *columns = malloc(LOOKUPS * sizeof(columns[0]));
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        columns[i] = (size_t) rand() % index->columns;
+    }
+
+    size_t check = 0;
+    start = now_secs();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        check += column_index_to_col(index, &line, columns[i]);
+    }
+    const double indexed = now_secs() - start;
+
+    size_t expected = 0;
+    start = now_secs();
+    for (size_t i = 0; i < LOOKUPS / 100; ++i) {
+        expected += scan_to_column(&line, columns[i]);
+    }
+    const double scanned = (now_secs() - start) * 100;
+
+    size_t indexed_check = 0;
+    for (size_t i = 0; i < LOOKUPS / 100; ++i) {
+        indexed_check += column_index_to_col(index, &line, columns[i]);
+    }
+    if (indexed_check != expected || check == 0) {
+        fprintf(stderr, "ERROR: the column index disagrees with a scan\n");
+        exit(1);
+    }
+
+    printf("row of %zu columns: index built in %.3f ms, column lookup %.1f ns indexed, %.1f us scanned\n",
+           index->columns, build * 1e3, indexed / LOOKUPS * 1e9, scanned / LOOKUPS * 1e6);
+    column_cache_clear(&cache);
+    free(columns);
+    free(text);
+}
+
+// Type and delete characters at random places in the row, keeping its
+// index up to date and looking up a column after every edit
+static void report_edits(void)
+{
+    char *text = make_text(ROW_BYTES, "\xe6\xbc\xa2", 1);
+    for (size_t i = 0; i < ROW_BYTES; ++i) {
+        if (text[i] == '\n') text[i] = ' ';
+    }
+    Line line = {0};
+    size_t col = 0;
+    line_insert_text_sized_before(&line, text, ROW_BYTES, &col);
+    static Column_Cache cache = {0};
+    uint64_t version = 0;
+    column_cache_get(&cache, 0, version, &line);
+
+    // Moving the gap of the row is not timed, only the index
+    size_t check = 0;
+    double edited = 0;
+    for (size_t i = 0; i < EDITS; ++i) {
+        Column_Index *index = column_cache_find(&cache, 0, version);
+        col = column_index_to_col(index, &line, (size_t) rand() % index->columns);
+        const size_t before = col;
+        const size_t size = line.size;
+        if (i % 2 == 0) {
+            line_insert_text_before(&line, "\xc3\xa9", &col);
+        } else {
+            line_delete(&line, &col);
+        }
+
+        const double start = now_secs();
+        if (i % 2 == 0) {
+            column_index_insert(index, &line, before, line.size - size);
+        } else {
+            column_index_delete(index, &line, before, size - line.size);
+        }
+        index->version = ++version;
+        check += column_index_to_col(column_cache_get(&cache, 0, version, &line), &line, (size_t) rand() % index->columns);
+        edited += now_secs() - start;
+    }
+
+    const Column_Index *kept = column_cache_get(&cache, 0, version, &line);
+    const size_t columns = kept->columns;
+    size_t expected = 0;
+    for (size_t i = 0; i < LOOKUPS / 100; ++i) {
+        expected += column_index_to_col(kept, &line, i * (columns / (LOOKUPS / 100)));
+    }
+    const Column_Index *built = column_cache_get(&cache, 0, ++version, &line);
+    size_t rebuilt = 0;
+    for (size_t i = 0; i < LOOKUPS / 100; ++i) {
+        rebuilt += column_index_to_col(built, &line, i * (columns / (LOOKUPS / 100)));
+    }
+    if (built->columns != columns || rebuilt != expected || check == 0) {
+        fprintf(stderr, "ERROR: the edited column index disagrees with a rebuilt one\n");
+        exit(1);
+    }
+
+    printf("row of %zu bytes: index update and column lookup after an edit %.2f us\n", line.size, edited / EDITS * 1e6);
+    column_cache_clear(&cache);
+    line_free(&line);
+    free(text);
+}
+
+int main(int argc, char **argv)
+{
+    const size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_MEGABYTES;
+    const size_t size = megabytes * 1024 * 1024;
+
+    char *ascii = make_text(size, "a", 1000000);
+    report("ascii", ascii, size);
+    free(ascii);
+
+    char *latin = make_text(size, "\xc3\xa9", 8);
+    report("latin", latin, size);
+    free(latin);
+
+    char *cjk = make_text(size, "\xe6\xbc\xa2", 1);
+    report("cjk", cjk, size);
+    free(cjk);
+
+    report_lookups();
+    report_edits();
+    return 0;
+}
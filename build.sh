@@ -2,10 +2,26 @@
 
 set -xe
 
-out="ted"
 cc="/usr/bin/gcc"
 cflags="-Wall -Wextra -std=c11 -pedantic -ggdb"
-libs="`pkg-config --cflags --libs sdl2` -lm"
+
+if [ "$1" == "bench" ]; then
+    core="line.c column_index.c utf8.c line_index.c piece_table.c slab.c newline_index.c line_loader.c file_saver.c trace.c"
+    $cc $cflags -O2 bench/editor_bench.c editor.c mapped_file.c $core -lpthread -o bench_editor
+    $cc $cflags -O2 bench/line_index_bench.c $core -lpthread -o bench_line_index
+    $cc $cflags -O2 bench/newline_index_bench.c newline_index.c -lpthread -o bench_newline_index
+    $cc $cflags -O2 bench/utf8_bench.c utf8.c line.c column_index.c slab.c trace.c -o bench_utf8
+    exit 0
+fi
+
+# ./build.sh trace records timing zones and dumps them to ted.trace.json
+# (or $TED_TRACE_FILE) on exit
+if [ "$1" == "trace" ]; then
+    cflags="$cflags -DTED_TRACE"
+fi
+
+out="ted"
+libs="`pkg-config --cflags --libs sdl2` -lm -lpthread"
 src=( $(ls *.c) )
 $cc $cflags -c ${src[*]}
 objs=( $(ls *.o) )
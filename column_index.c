@@ -0,0 +1,328 @@
+#include <string.h>
+#include <assert.h>
+#include "./column_index.h"
+#include "./utf8.h"
+#include "./trace.h"
+
+// Continuation bytes right before `col`, as utf8_count_starts takes them
+static size_t line_run_before(const Line *line, size_t col)
+{
+    size_t run = 0;
+    while (run < UTF8_MAX_CONTINUATIONS) {
+        if (run == col) return UTF8_MAX_CONTINUATIONS;
+        if (!UTF8_IS_CONTINUATION(*line_char_at(line, col - run - 1))) break;
+        run += 1;
+    }
+    return run;
+}
+
+// Byte offset of the character `n` columns after the one starting at
+// `col`, or the end of the line
+static size_t line_skip_columns(const Line *line, size_t col, size_t n)
+{
+    if (n == 0 || col >= line->size) {
+        return col < line->size ? col : line->size;
+    }
+
+    size_t before_size = 0;
+    size_t after_size = 0;
+    const char *before = line_text_before_gap(line, &before_size);
+    const char *after = line_text_after_gap(line, &after_size);
+
+    // The n-th start byte past `col`
+    size_t pos = col + 1;
+    size_t run = line_run_before(line, pos);
+    n -= 1;
+    if (pos < before_size) {
+        const size_t i = utf8_find_start(before + pos, before_size - pos, &n, &run);
+        if (pos + i < before_size) return pos + i;
+        pos = before_size;
+    }
+    const size_t offset = pos - before_size;
+    return pos + utf8_find_start(after + offset, after_size - offset, &n, &run);
+}
+
+// Number of start bytes in [begin, end)
+static size_t line_count_starts(const Line *line, size_t begin, size_t end)
+{
+    size_t before_size = 0;
+    size_t after_size = 0;
+    const char *before = line_text_before_gap(line, &before_size);
+    const char *after = line_text_after_gap(line, &after_size);
+
+    size_t count = 0;
+    size_t run = line_run_before(line, begin);
+    if (begin < before_size) {
+        const size_t stop = end < before_size ? end : before_size;
+        count += utf8_count_starts(before + begin, stop - begin, &run);
+    }
+    if (end > before_size) {
+        const size_t from = begin > before_size ? begin - before_size : 0;
+        count += utf8_count_starts(after + from, end - before_size - from, &run);
+    }
+    return count;
+}
+
+// Column of `col` given that `start` begins column `column`. The first
+// byte of a row always starts a column, even a stray continuation byte.
+static size_t line_column_from(const Line *line, size_t start, size_t column, size_t col)
+{
+    if (col <= start) return column;
+    return column + 1 + line_count_starts(line, start + 1, col);
+}
+
+static void column_index_push(Column_Start **starts, size_t *count, size_t *capacity, Column_Start start)
+{
+    if (*count == *capacity) {
+        *capacity = *capacity == 0 ? 16 : *capacity * 2;
+        *starts = realloc(*starts, *capacity * sizeof(**starts));
+        assert(*starts != NULL);
+    }
+    (*starts)[(*count)++] = start;
+}
+
+// Push a start every STRIDE columns after `from` and before byte `end`,
+// which starts a character or ends the line. Returns the column of `end`.
+static size_t column_index_scan(const Line *line, Column_Start from, size_t end,
+                                Column_Start **starts, size_t *count, size_t *capacity)
+{
+    Column_Start at = from;
+    for (;;) {
+        const size_t next = line_skip_columns(line, at.col, COLUMN_INDEX_STRIDE);
+        if (next >= end) break;
+        at = (Column_Start) {
+            .col = next,
+            .column = at.column + COLUMN_INDEX_STRIDE,
+        };
+        column_index_push(starts, count, capacity, at);
+    }
+    return line_column_from(line, at.col, at.column, end);
+}
+
+static bool line_is_ascii(const Line *line, size_t begin, size_t end)
+{
+    size_t before_size = 0;
+    size_t after_size = 0;
+    const char *before = line_text_before_gap(line, &before_size);
+    const char *after = line_text_after_gap(line, &after_size);
+
+    if (begin < before_size) {
+        const size_t stop = end < before_size ? end : before_size;
+        if (!utf8_is_ascii(before + begin, stop - begin)) return false;
+    }
+    if (end > before_size) {
+        const size_t from = begin > before_size ? begin - before_size : 0;
+        if (!utf8_is_ascii(after + from, end - before_size - from)) return false;
+    }
+    return true;
+}
+
+static void column_index_build(Column_Index *index, const Line *line)
+{
+    TRACE_FUNCTION();
+    index->start_count = 0;
+    if (line_is_ascii(line, 0, line->size)) {
+        free(index->starts);
+        index->starts = NULL;
+        index->start_capacity = 0;
+        index->columns = line->size;
+        return;
+    }
+
+    const Column_Start first = {0};
+    column_index_push(&index->starts, &index->start_count, &index->start_capacity, first);
+    index->columns = column_index_scan(line, first, line->size,
+                                       &index->starts, &index->start_count, &index->start_capacity);
+}
+
+// Replace the starts of an ASCII row of `size` bytes by ones at every
+// STRIDE bytes, so non-ASCII text can be added to it
+static void column_index_unpack_ascii(Column_Index *index, size_t size)
+{
+    for (size_t col = 0; col == 0 || col < size; col += COLUMN_INDEX_STRIDE) {
+        const Column_Start start = {
+            .col = col,
+            .column = col,
+        };
+        column_index_push(&index->starts, &index->start_count, &index->start_capacity, start);
+    }
+}
+
+// Update the index after `inserted` bytes replaced `deleted` ones at
+// `col` of `line`. Whether a byte starts a character depends only on the
+// bytes up to 3 before it, so the starts before `col` stand, and those
+// more than 3 bytes past the edit only move. The ones in between are
+// scanned again.
+static void column_index_edit(Column_Index *index, const Line *line, size_t col, size_t inserted, size_t deleted)
+{
+    TRACE_FUNCTION();
+    if (index->starts == NULL) {
+        if (line_is_ascii(line, col, col + inserted)) {
+            index->columns = index->columns + inserted - deleted;
+            return;
+        }
+        column_index_unpack_ascii(index, index->columns);
+    }
+
+    // Last start before `col`, or the first one
+    size_t lo = 0;
+    size_t hi = index->start_count;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (index->starts[mid].col < col) lo = mid;
+        else hi = mid;
+    }
+    const size_t first = lo;
+
+    size_t last = first + 1;
+    while (last < index->start_count && index->starts[last].col < col + deleted + UTF8_MAX_CONTINUATIONS) {
+        last += 1;
+    }
+    const size_t end = last < index->start_count ? index->starts[last].col - deleted + inserted : line->size;
+
+    Column_Start *scanned = NULL;
+    size_t scanned_count = 0;
+    size_t scanned_capacity = 0;
+    const size_t end_column = column_index_scan(line, index->starts[first], end, &scanned, &scanned_count, &scanned_capacity);
+
+    const size_t tail = index->start_count - last;
+    const size_t count = first + 1 + scanned_count + tail;
+    if (count > index->start_capacity) {
+        while (count > index->start_capacity) {
+            index->start_capacity *= 2;
+        }
+        index->starts = realloc(index->starts, index->start_capacity * sizeof(index->starts[0]));
+        assert(index->starts != NULL);
+    }
+
+    if (tail > 0) {
+        const size_t old_column = index->starts[last].column;
+        Column_Start *moved = index->starts + first + 1 + scanned_count;
+        memmove(moved, index->starts + last, tail * sizeof(index->starts[0]));
+        for (size_t i = 0; i < tail; ++i) {
+            moved[i].col = moved[i].col - deleted + inserted;
+            moved[i].column = moved[i].column - old_column + end_column;
+        }
+        index->columns = index->columns - old_column + end_column;
+    } else {
+        index->columns = end_column;
+    }
+    if (scanned_count > 0) {
+        memcpy(index->starts + first + 1, scanned, scanned_count * sizeof(scanned[0]));
+    }
+    index->start_count = count;
+    free(scanned);
+}
+
+// After `size` bytes were inserted at `col` of `line`
+void column_index_insert(Column_Index *index, const Line *line, size_t col, size_t size)
+{
+    column_index_edit(index, line, col, size, 0);
+}
+
+// After `size` bytes were deleted at `col` of `line`
+void column_index_delete(Column_Index *index, const Line *line, size_t col, size_t size)
+{
+    column_index_edit(index, line, col, 0, size);
+}
+
+static Column_Index *column_cache_slot(Column_Cache *cache, uint64_t id)
+{
+    uint64_t h = id * 0x9e3779b97f4a7c15ull;
+    return &cache->entries[(h ^ (h >> 32)) % COLUMN_CACHE_SIZE];
+}
+
+// The index of `line`, the row `id` with text `version`. The pointer is
+// good until the next call.
+const Column_Index *column_cache_get(Column_Cache *cache, uint64_t id, uint64_t version, const Line *line)
+{
+    Column_Index *index = column_cache_slot(cache, id);
+    if (!index->used || index->id != id || index->version != version) {
+        column_index_build(index, line);
+        index->used = true;
+        index->id = id;
+        index->version = version;
+    }
+    return index;
+}
+
+// The cached index of row `id` with text `version`, or NULL. The caller
+// may edit it along with the row and set its new version.
+Column_Index *column_cache_find(Column_Cache *cache, uint64_t id, uint64_t version)
+{
+    Column_Index *index = column_cache_slot(cache, id);
+    if (!index->used || index->id != id || index->version != version) {
+        return NULL;
+    }
+    return index;
+}
+
+// Keep the index of a row whose id or version changed but not its text
+void column_cache_rename(Column_Cache *cache, uint64_t id, uint64_t version, uint64_t new_id, uint64_t new_version)
+{
+    Column_Index *index = column_cache_find(cache, id, version);
+    if (index == NULL) {
+        return;
+    }
+
+    Column_Index *slot = column_cache_slot(cache, new_id);
+    if (slot != index) {
+        free(slot->starts);
+        *slot = *index;
+        *index = (Column_Index) {0};
+    }
+    slot->id = new_id;
+    slot->version = new_version;
+}
+
+// Versions start over with every document
+void column_cache_clear(Column_Cache *cache)
+{
+    for (size_t i = 0; i < COLUMN_CACHE_SIZE; ++i) {
+        free(cache->entries[i].starts);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
+// Byte offset where `column` starts, or the end of the line past its
+// last column
+size_t column_index_to_col(const Column_Index *index, const Line *line, size_t column)
+{
+    if (column >= index->columns) {
+        return line->size;
+    }
+    if (index->starts == NULL) {
+        return column;
+    }
+
+    // Last start at or before `column`
+    size_t lo = 0;
+    size_t hi = index->start_count;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (index->starts[mid].column <= column) lo = mid;
+        else hi = mid;
+    }
+    return line_skip_columns(line, index->starts[lo].col, column - index->starts[lo].column);
+}
+
+// Column of the character starting at byte `col`
+size_t column_index_to_column(const Column_Index *index, const Line *line, size_t col)
+{
+    if (col >= line->size) {
+        return index->columns;
+    }
+    if (index->starts == NULL) {
+        return col;
+    }
+
+    // Last start at or before `col`
+    size_t lo = 0;
+    size_t hi = index->start_count;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (index->starts[mid].col <= col) lo = mid;
+        else hi = mid;
+    }
+    return line_column_from(line, index->starts[lo].col, index->starts[lo].column, col);
+}
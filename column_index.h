@@ -0,0 +1,48 @@
+#ifndef COLUMN_INDEX_H_
+#define COLUMN_INDEX_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "./line.h"
+
+#define COLUMN_INDEX_STRIDE 64
+#define COLUMN_CACHE_SIZE 1024
+
+// Where the columns of one version of a row start. Every character takes
+// one column. `starts` are characters at most STRIDE columns apart,
+// beginning with the first, so a column is found from the nearest start
+// before it by skipping at most STRIDE - 1 characters. An edit moves the
+// starts after it and rescans only those around it. ASCII rows, where
+// columns are bytes, need no starts.
+typedef struct {
+    size_t col;
+    size_t column;
+} Column_Start;
+
+typedef struct {
+    bool used;
+    uint64_t id;
+    uint64_t version;
+    size_t columns;
+    Column_Start *starts;
+    size_t start_count;
+    size_t start_capacity;
+} Column_Index;
+
+// Indexes of recently used rows, keyed by editor_line_id and built on
+// first use. One whose version is not the row's any more is built again,
+// unless the editor keeps it up to date through its edits.
+typedef struct {
+    Column_Index entries[COLUMN_CACHE_SIZE];
+} Column_Cache;
+
+const Column_Index *column_cache_get(Column_Cache *cache, uint64_t id, uint64_t version, const Line *line);
+Column_Index *column_cache_find(Column_Cache *cache, uint64_t id, uint64_t version);
+void column_cache_rename(Column_Cache *cache, uint64_t id, uint64_t version, uint64_t new_id, uint64_t new_version);
+void column_cache_clear(Column_Cache *cache);
+void column_index_insert(Column_Index *index, const Line *line, size_t col, size_t size);
+void column_index_delete(Column_Index *index, const Line *line, size_t col, size_t size);
+size_t column_index_to_col(const Column_Index *index, const Line *line, size_t column);
+size_t column_index_to_column(const Column_Index *index, const Line *line, size_t col);
+
+#endif // COLUMN_INDEX_H_
@@ -0,0 +1,8 @@
+#ifndef CP437_H_
+#define CP437_H_
+#include <stdint.h>
+
+int cp437_from_codepoint(uint32_t codepoint);
+uint32_t cp437_slot_codepoint(int byte);
+
+#endif // CP437_H_
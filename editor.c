@@ -1,159 +1,462 @@
+#include <stdio.h>
 #include <string.h>
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include "./editor.h"
+#include "./trace.h"
 
-#define LINE_INIT_CAPACITY 1024
-#define EDITOR_INIT_CAPACITY 128
+static void editor_invalidate(Editor *editor, size_t begin, size_t end)
+{
+    if (editor->dirty_begin >= editor->dirty_end) {
+        editor->dirty_begin = begin;
+        editor->dirty_end = end;
+    } else {
+        if (begin < editor->dirty_begin) editor->dirty_begin = begin;
+        if (end > editor->dirty_end) editor->dirty_end = end;
+    }
+    editor->dirty = true;
+}
+
+// While loading, the last row is still growing and may be followed by
+// rows that are not indexed yet, so it can't be edited
+static bool editor_row_editable(Editor *editor, size_t row)
+{
+    return !editor_loading(editor) || row + 1 < editor_rows(editor);
+}
+
+// Editable row. The column index of an original row follows it into
+// the add buffer.
+static Line *editor_edit_line(Editor *editor, size_t row)
+{
+    const uint64_t id = piece_table_line_id(&editor->doc, row);
+    const uint64_t version = piece_table_line_version(&editor->doc, row);
+    Line *line = piece_table_line(&editor->doc, row);
+    column_cache_rename(&editor->columns, id, version,
+                        piece_table_line_id(&editor->doc, row),
+                        piece_table_line_version(&editor->doc, row));
+    return line;
+}
 
-static void line_grow(Line *line, size_t n)
+// Finish an edit that replaced `deleted` bytes at `col` of `row` with
+// `inserted` ones, updating its column index if it has one
+static void editor_update_line(Editor *editor, size_t row, size_t col, size_t inserted, size_t deleted)
 {
-    size_t new_capacity = line->capacity;
+    Column_Index *index = column_cache_find(&editor->columns,
+                                            piece_table_line_id(&editor->doc, row),
+                                            piece_table_line_version(&editor->doc, row));
+    piece_table_update_line(&editor->doc, row);
+    if (index != NULL) {
+        const Line line = piece_table_peek_line(&editor->doc, row);
+        if (deleted > 0) column_index_delete(index, &line, col, deleted);
+        if (inserted > 0) column_index_insert(index, &line, col, inserted);
+        index->version = piece_table_line_version(&editor->doc, row);
+    }
+}
 
-    while (new_capacity - line->size < n) {
-        if (new_capacity == 0) {
-            new_capacity = LINE_INIT_CAPACITY;
+// Clamp the cursor to an existing position (creating the first row if
+// the document is empty) and return its row ready for editing, or NULL
+// if it can't be edited yet.
+static Line *editor_cursor_line(Editor *editor)
+{
+    if (editor->cursor_row >= editor_rows(editor)) {
+        if (editor_loading(editor)) {
+            return NULL;
+        } else if (editor_rows(editor) > 0) {
+            editor->cursor_row = editor_rows(editor) - 1;
         } else {
-            new_capacity *= 2;
+            piece_table_insert_line(&editor->doc, 0);
+            piece_table_set_line_ending(&editor->doc, 0, LINE_ENDING_NONE);
+            editor->cursor_row = 0;
+            editor_invalidate(editor, 0, SIZE_MAX);
         }
     }
-    if (new_capacity != line->capacity) {
-        line->chars = realloc(line->chars, new_capacity);
+    if (!editor_row_editable(editor, editor->cursor_row)) {
+        return NULL;
+    }
+
+    Line *line = editor_edit_line(editor, editor->cursor_row);
+    if (editor->cursor_col > line->size) {
+        editor->cursor_col = line->size;
     }
+    editor->has_goal = false;
+    return line;
 }
 
-void line_insert_text_before(Line *line, const char* text, size_t *col)
+static const Column_Index *editor_column_index(Editor *editor, size_t row, Line *line)
 {
+    *line = piece_table_peek_line(&editor->doc, row);
+    return column_cache_get(&editor->columns,
+                            piece_table_line_id(&editor->doc, row),
+                            piece_table_line_version(&editor->doc, row),
+                            line);
+}
 
-    if (*col > line->size) {
-        *col = line->size;
-    }
+bool editor_open_file(Editor *editor, const char *file_path)
+{
+    TRACE_FUNCTION();
+    editor_free(editor);
 
-    const size_t text_size = strlen(text);
-    line_grow(line, text_size);
+    if (!mapped_file_open(&editor->file, file_path)) {
+        return false;
+    }
 
-    memmove(line->chars + *col + text_size,
-            line->chars + *col,
-            line->size - *col);
-    memcpy(line->chars + *col, text, text_size);
-    line->size += text_size;
-    *col += text_size;
+    piece_table_load_lazy(&editor->doc, editor->file.data, editor->file.size);
+    line_loader_start(&editor->loader, editor->file.data, editor->file.size);
+    editor_poll_load(editor);
+    editor_invalidate(editor, 0, SIZE_MAX);
+    return true;
 }
 
-void line_backspace(Line *line, size_t *col)
+// Add the rows the loader has indexed since the last poll, and grow the
+// last row to the text scanned after them. Returns true if anything
+// changed.
+bool editor_poll_load(Editor *editor)
 {
-    if (*col > line->size) {
-        *col = line->size;
+    // Done before the take means these are the last rows, and the error
+    // count is final
+    const bool done = line_loader_done(&editor->loader);
+    size_t count = 0;
+    size_t scanned = 0;
+    size_t *starts = line_loader_take(&editor->loader, &count, &scanned);
+
+    if (done && !editor->utf8_reported) {
+        editor->utf8_reported = true;
+        size_t first_error = 0;
+        const size_t errors = line_loader_utf8_errors(&editor->loader, &first_error);
+        if (errors > 0) {
+            fprintf(stderr, "WARNING: the file is not valid UTF-8: %zu bad characters, the first at byte %zu. They are shown as U+FFFD.\n",
+                    errors, first_error);
+        }
     }
 
-    if (*col > 0 && line->size > 0) {
-        memmove(line->chars + *col - 1,
-                line->chars + *col,
-                line->size - *col);
-        line->size -= 1;
+    if (count == 0 && scanned <= editor->doc.original_end) {
+        free(starts);
+        return false;
     }
-    *col -= 1;
+
+    TRACE_FUNCTION();
+    const size_t rows = editor_rows(editor);
+    editor_invalidate(editor, rows > 0 ? rows - 1 : 0, SIZE_MAX);
+    piece_table_append_original(&editor->doc, starts, count, scanned);
+    free(starts);
+    return true;
 }
 
-void line_delete(Line *line, size_t *col)
+// True until every row of the file has been added to the document, not
+// just found by the loader
+bool editor_loading(Editor *editor)
 {
-    if (*col > line->size) {
-        *col = line->size;
-    }
+    return !line_loader_done(&editor->loader) || editor->doc.original_end < editor->doc.original_size;
+}
 
-    if (*col < line->size && line->size > 0) {
-        memmove(line->chars + *col,
-                line->chars + *col + 1,
-                line->size - *col - 1);
-        line->size -= 1;
+float editor_load_progress(Editor *editor)
+{
+    return line_loader_progress(&editor->loader);
+}
+
+// Start saving the document in the background. Returns false if the
+// previous save has not finished yet.
+bool editor_save(Editor *editor, const char *file_path)
+{
+    TRACE_FUNCTION();
+    if (editor_saving(editor)) {
+        return false;
     }
+
+    file_saver_wait(&editor->saver);
+    file_saver_start(&editor->saver, &editor->doc, file_path);
+    return true;
 }
 
-static void editor_grow(Editor *editor, size_t n)
+bool editor_saving(Editor *editor)
 {
-    size_t new_capacity = editor->capacity;
+    return !file_saver_done(&editor->saver);
+}
 
-    while (new_capacity - editor->size < n) {
-        if (new_capacity == 0) {
-            new_capacity = EDITOR_INIT_CAPACITY;
-        } else {
-            new_capacity *= 2;
-        }
-    }
-    if (new_capacity != editor->capacity) {
-        editor->lines = realloc(editor->lines, new_capacity * sizeof(editor->lines[0]));
+// Returns true, with its stats, once for every save that finishes
+bool editor_poll_save(Editor *editor, Save_Stats *stats)
+{
+    if (!editor->saver.active || editor_saving(editor)) {
+        return false;
     }
+
+    file_saver_wait(&editor->saver);
+    *stats = file_saver_stats(&editor->saver);
+    editor->dirty = true;
+    return true;
+}
+
+// Progress of the current save, or the stats of the last one
+Save_Stats editor_save_stats(Editor *editor)
+{
+    return file_saver_stats(&editor->saver);
 }
 
 void editor_insert_new_line(Editor *editor)
 {
-    if (editor->cursor_row > editor->size) {
-        editor->cursor_row = editor->size;
+    TRACE_FUNCTION();
+    if (editor_cursor_line(editor) == NULL) return;
+    editor_invalidate(editor, editor->cursor_row, SIZE_MAX);
+    Line *next = piece_table_insert_line(&editor->doc, editor->cursor_row + 1);
+    // The insertion may have moved the add buffer, so fetch the row again
+    Line *line = piece_table_line(&editor->doc, editor->cursor_row);
+    const size_t size = line->size;
+    line_split(line, editor->cursor_col, next);
+    editor_update_line(editor, editor->cursor_row, editor->cursor_col, 0, size - editor->cursor_col);
+    piece_table_update_line(&editor->doc, editor->cursor_row + 1);
+    // The second half keeps the row's ending. The first half ends like
+    // the row did, or like the row above if that was the unterminated
+    // last row.
+    const Line_Ending ending = piece_table_line_ending(&editor->doc, editor->cursor_row);
+    Line_Ending first = ending;
+    if (first == LINE_ENDING_NONE) {
+        first = editor->cursor_row > 0 && piece_table_line_ending(&editor->doc, editor->cursor_row - 1) == LINE_ENDING_CRLF
+            ? LINE_ENDING_CRLF
+            : LINE_ENDING_LF;
     }
+    piece_table_set_line_ending(&editor->doc, editor->cursor_row + 1, ending);
+    piece_table_set_line_ending(&editor->doc, editor->cursor_row, first);
 
-    editor_grow(editor, 1);
-
-    const size_t line_size = sizeof(editor->lines[0]);
-    memmove(editor->lines + editor->cursor_row + 1,
-            editor->lines + editor->cursor_row ,
-            (editor->size - editor->cursor_row) * line_size);
-    memset(&editor->lines[editor->cursor_row  + 1], 0, line_size);
     editor->cursor_row += 1;
     editor->cursor_col = 0;
-    editor->size += 1;
 }
 
-static void editor_push_new_line(Editor *editor)
+void editor_insert_text_before_cursor(Editor *editor, const char *text)
 {
-    editor_grow(editor, 1);
-    memset(&editor->lines[editor->size], 0, sizeof(editor->lines[0]));
-    editor->size += 1;
+    TRACE_FUNCTION();
+    Line *line = editor_cursor_line(editor);
+    if (line == NULL) return;
+    editor_invalidate(editor, editor->cursor_row, editor->cursor_row + 1);
+    const size_t col = editor->cursor_col;
+    line_insert_text_before(line, text, &editor->cursor_col);
+    editor_update_line(editor, editor->cursor_row, col, editor->cursor_col - col, 0);
 }
 
-void editor_insert_text_before_cursor(Editor *editor, const char *text)
+void editor_backspace(Editor *editor)
 {
-    if (editor->cursor_row >= editor->size) {
-        if (editor->size > 0) {
-            editor->cursor_row = editor->size - 1;
-        } else {
-            editor_push_new_line(editor);
-        }
+    TRACE_FUNCTION();
+    Line *line = editor_cursor_line(editor);
+    if (line == NULL) return;
+
+    if (editor->cursor_col == 0 && editor->cursor_row > 0) {
+        editor_invalidate(editor, editor->cursor_row - 1, SIZE_MAX);
+        Line *prev = editor_edit_line(editor, editor->cursor_row - 1);
+        const Line view = piece_table_peek_line(&editor->doc, editor->cursor_row);
+        const Line_Ending ending = piece_table_line_ending(&editor->doc, editor->cursor_row);
+        editor->cursor_col = prev->size;
+        line_join(prev, &view);
+        piece_table_delete_line(&editor->doc, editor->cursor_row);
+        editor->cursor_row -= 1;
+        piece_table_set_line_ending(&editor->doc, editor->cursor_row, ending);
+        editor_update_line(editor, editor->cursor_row, editor->cursor_col, view.size, 0);
+    } else {
+        editor_invalidate(editor, editor->cursor_row, editor->cursor_row + 1);
+        const size_t col = editor->cursor_col;
+        line_backspace(line, &editor->cursor_col);
+        editor_update_line(editor, editor->cursor_row, editor->cursor_col, 0, col - editor->cursor_col);
     }
+}
 
-    line_insert_text_before(&editor->lines[editor->cursor_row], text, &editor->cursor_col);
+void editor_delete(Editor *editor)
+{
+    TRACE_FUNCTION();
+    Line *line = editor_cursor_line(editor);
+    if (line == NULL) return;
+
+    if (editor->cursor_col >= line->size && editor->cursor_row + 1 < editor_rows(editor)) {
+        if (!editor_row_editable(editor, editor->cursor_row + 1)) return;
+        editor_invalidate(editor, editor->cursor_row, SIZE_MAX);
+        const Line view = piece_table_peek_line(&editor->doc, editor->cursor_row + 1);
+        const Line_Ending ending = piece_table_line_ending(&editor->doc, editor->cursor_row + 1);
+        editor->cursor_col = line->size;
+        line_join(line, &view);
+        piece_table_delete_line(&editor->doc, editor->cursor_row + 1);
+        piece_table_set_line_ending(&editor->doc, editor->cursor_row, ending);
+        editor_update_line(editor, editor->cursor_row, editor->cursor_col, view.size, 0);
+    } else {
+        editor_invalidate(editor, editor->cursor_row, editor->cursor_row + 1);
+        const size_t size = line->size;
+        line_delete(line, &editor->cursor_col);
+        editor_update_line(editor, editor->cursor_row, editor->cursor_col, 0, size - line->size);
+    }
 }
 
-void editor_backspace(Editor *editor)
+bool editor_char_under_cursor(const Editor *editor, uint32_t *codepoint)
 {
-    if (editor->cursor_row >= editor->size) {
-        if (editor->size > 0) {
-            editor->cursor_row = editor->size - 1;
-        } else {
-            editor_push_new_line(editor);
+    if (editor->cursor_row < editor_rows(editor)) {
+        const Line line = piece_table_peek_line(&editor->doc, editor->cursor_row);
+        if (editor->cursor_col < line.size) {
+            line_decode(&line, editor->cursor_col, codepoint);
+            return true;
         }
     }
-    line_backspace(&editor->lines[editor->cursor_row], &editor->cursor_col);
+    return false;
 }
 
-void editor_delete(Editor *editor)
+void editor_move_left(Editor *editor)
 {
-    if (editor->cursor_row >= editor->size) {
-        if (editor->size > 0) {
-            editor->cursor_row = editor->size - 1;
-        } else {
-            editor_push_new_line(editor);
-        }
+    if (editor->cursor_row >= editor_rows(editor)) return;
+    const Line line = piece_table_peek_line(&editor->doc, editor->cursor_row);
+    editor->cursor_col = line_prev_col(&line, editor->cursor_col);
+    editor->has_goal = false;
+}
+
+void editor_move_right(Editor *editor)
+{
+    if (editor->cursor_row >= editor_rows(editor)) return;
+    const Line line = piece_table_peek_line(&editor->doc, editor->cursor_row);
+    editor->cursor_col = line_next_col(&line, editor->cursor_col);
+    editor->has_goal = false;
+}
+
+// Move the cursor up (negative) or down by `rows`, to the character in
+// the column it came from
+void editor_move_rows(Editor *editor, long rows)
+{
+    if (editor_rows(editor) == 0) return;
+    if (!editor->has_goal) {
+        editor->goal_column = editor_cursor_column(editor);
+        editor->has_goal = true;
     }
 
-    line_delete(&editor->lines[editor->cursor_row], &editor->cursor_col);
+    if (rows < 0 && (size_t) -rows > editor->cursor_row) {
+        editor->cursor_row = 0;
+    } else {
+        editor->cursor_row += rows;
+    }
+    if (editor->cursor_row >= editor_rows(editor)) {
+        editor->cursor_row = editor_rows(editor) - 1;
+    }
+    editor->cursor_col = editor_column_to_col(editor, editor->cursor_row, editor->goal_column);
 }
 
-const char *editor_char_under_cursor(const Editor *editor)
+size_t editor_cursor_column(Editor *editor)
 {
-    if (editor->cursor_row < editor->size) {
-        if (editor->cursor_col < editor->lines[editor->cursor_row].size) {
-            return &editor->lines[editor->cursor_row].chars[editor->cursor_col];
-        }
+    if (editor->cursor_row >= editor_rows(editor)) return 0;
+    return editor_col_to_column(editor, editor->cursor_row, editor->cursor_col);
+}
+
+size_t editor_line_columns(Editor *editor, size_t row)
+{
+    Line line = {0};
+    return editor_column_index(editor, row, &line)->columns;
+}
+
+// Byte offset of `column` in `row`, clamped to the end of the row.
+// Binary search of the row's index plus a scan of at most
+// COLUMN_INDEX_STRIDE characters.
+size_t editor_column_to_col(Editor *editor, size_t row, size_t column)
+{
+    Line line = {0};
+    const Column_Index *index = editor_column_index(editor, row, &line);
+    return column_index_to_col(index, &line, column);
+}
+
+size_t editor_col_to_column(Editor *editor, size_t row, size_t col)
+{
+    Line line = {0};
+    const Column_Index *index = editor_column_index(editor, row, &line);
+    return column_index_to_column(index, &line, col);
+}
+
+// Scroll just enough for the cursor to be inside a window of
+// `visible_rows` by `visible_cols` characters
+void editor_scroll_to_cursor(Editor *editor, size_t visible_rows, size_t visible_cols)
+{
+    TRACE_FUNCTION();
+    if (visible_rows == 0) visible_rows = 1;
+    if (visible_cols == 0) visible_cols = 1;
+    const size_t scroll_row = editor->scroll_row;
+    const size_t scroll_col = editor->scroll_col;
+
+    if (editor->cursor_row < editor->scroll_row) {
+        editor->scroll_row = editor->cursor_row;
+    } else if (editor->cursor_row >= editor->scroll_row + visible_rows) {
+        editor->scroll_row = editor->cursor_row - visible_rows + 1;
+    }
+
+    const size_t column = editor_cursor_column(editor);
+    if (column < editor->scroll_col) {
+        editor->scroll_col = column;
+    } else if (column >= editor->scroll_col + visible_cols) {
+        editor->scroll_col = column - visible_cols + 1;
+    }
+
+    if (editor->scroll_row != scroll_row || editor->scroll_col != scroll_col) {
+        editor->dirty = true;
+    }
+}
+
+// Scroll without moving the cursor, keeping the last row reachable
+void editor_scroll_by(Editor *editor, long rows)
+{
+    editor->dirty = true;
+    if (rows < 0 && (size_t) -rows > editor->scroll_row) {
+        editor->scroll_row = 0;
+    } else {
+        editor->scroll_row += rows;
     }
-    return NULL;
+
+    const size_t last = editor_rows(editor) > 0 ? editor_rows(editor) - 1 : 0;
+    if (editor->scroll_row > last) {
+        editor->scroll_row = last;
+    }
+}
+
+// Called by the renderer once it has drawn every change
+void editor_mark_clean(Editor *editor)
+{
+    editor->dirty = false;
+    editor->dirty_begin = 0;
+    editor->dirty_end = 0;
+}
+
+size_t editor_rows(const Editor *editor)
+{
+    return piece_table_rows(&editor->doc);
+}
+
+Line editor_peek_line(const Editor *editor, size_t row)
+{
+    return piece_table_peek_line(&editor->doc, row);
+}
+
+uint64_t editor_line_version(const Editor *editor, size_t row)
+{
+    return piece_table_line_version(&editor->doc, row);
+}
+
+uint64_t editor_line_id(const Editor *editor, size_t row)
+{
+    return piece_table_line_id(&editor->doc, row);
+}
+
+size_t editor_slack_bytes(const Editor *editor)
+{
+    return piece_table_slack_bytes(&editor->doc);
+}
+
+Slab_Stats editor_slab_stats(const Editor *editor)
+{
+    return piece_table_slab_stats(&editor->doc);
+}
+
+void editor_free(Editor *editor)
+{
+    TRACE_FUNCTION();
+    // The saver and the loader read the mapping, so they have to finish
+    // before it is unmapped
+    file_saver_wait(&editor->saver);
+    line_loader_stop(&editor->loader);
+    piece_table_free(&editor->doc);
+    column_cache_clear(&editor->columns);
+    mapped_file_close(&editor->file);
+    editor->utf8_reported = false;
+    editor->cursor_row = 0;
+    editor->cursor_col = 0;
+    editor->has_goal = false;
+    editor->scroll_row = 0;
+    editor->scroll_col = 0;
+    editor_invalidate(editor, 0, SIZE_MAX);
 }
@@ -1,29 +1,75 @@
 #ifndef EDITOR_H_
 #define EDITOR_H_
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "./line.h"
+#include "./piece_table.h"
+#include "./mapped_file.h"
+#include "./line_loader.h"
+#include "./file_saver.h"
+#include "./column_index.h"
 
+// The document is loaded straight from a mapping of the file: untouched
+// rows are read from `file` and only rows that get edited are copied.
+// Rows past the first screen are indexed by `loader` in the background
+// and show up at the end of the document as editor_poll_load finds them.
 typedef struct {
-    size_t capacity;
-    size_t size;
-    char *chars;
-} Line;
-
-void line_insert_text_before(Line *line, const char* text, size_t *col);
-void line_backspace(Line *line, size_t *col);
-void line_delete(Line *line, size_t *col);
-
-typedef struct {
-    size_t capacity;
-    size_t size;
-    Line *lines;
+    Mapped_File file;
+    Line_Loader loader;
+    File_Saver saver;
+    Piece_Table doc;
+    // The invalid UTF-8 warning was printed for the loaded file
+    bool utf8_reported;
+    // cursor_col is a byte offset into the row, always at the start of a
+    // character. While moving up and down the cursor aims for
+    // goal_column, the column it started from.
     size_t cursor_row;
     size_t cursor_col;
+    size_t goal_column;
+    bool has_goal;
+    // First row and column shown in the window. Columns count characters.
+    size_t scroll_row;
+    size_t scroll_col;
+    Column_Cache columns;
+    // Set by anything that changes what the window shows; cleared by the
+    // renderer once it has drawn the change
+    bool dirty;
+    // Rows [dirty_begin, dirty_end) changed since the last repaint.
+    // dirty_end is SIZE_MAX when every row from dirty_begin on moved.
+    size_t dirty_begin;
+    size_t dirty_end;
 } Editor;
 
+bool editor_open_file(Editor *editor, const char *file_path);
+bool editor_poll_load(Editor *editor);
+bool editor_loading(Editor *editor);
+float editor_load_progress(Editor *editor);
+bool editor_save(Editor *editor, const char *file_path);
+bool editor_saving(Editor *editor);
+bool editor_poll_save(Editor *editor, Save_Stats *stats);
+Save_Stats editor_save_stats(Editor *editor);
 void editor_insert_text_before_cursor(Editor *editor, const char *text);
 void editor_insert_new_line(Editor *editor);
 void editor_backspace(Editor *editor);
 void editor_delete(Editor *editor);
-const char *editor_char_under_cursor(const Editor *editor);
+bool editor_char_under_cursor(const Editor *editor, uint32_t *codepoint);
+void editor_move_left(Editor *editor);
+void editor_move_right(Editor *editor);
+void editor_move_rows(Editor *editor, long rows);
+size_t editor_cursor_column(Editor *editor);
+size_t editor_line_columns(Editor *editor, size_t row);
+size_t editor_column_to_col(Editor *editor, size_t row, size_t column);
+size_t editor_col_to_column(Editor *editor, size_t row, size_t col);
+void editor_scroll_to_cursor(Editor *editor, size_t visible_rows, size_t visible_cols);
+void editor_scroll_by(Editor *editor, long rows);
+void editor_mark_clean(Editor *editor);
+size_t editor_rows(const Editor *editor);
+Line editor_peek_line(const Editor *editor, size_t row);
+uint64_t editor_line_version(const Editor *editor, size_t row);
+uint64_t editor_line_id(const Editor *editor, size_t row);
+size_t editor_slack_bytes(const Editor *editor);
+Slab_Stats editor_slab_stats(const Editor *editor);
+void editor_free(Editor *editor);
 
 #endif // EDITOR_H_
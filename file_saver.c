@@ -0,0 +1,298 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "./file_saver.h"
+#include "./trace.h"
+
+// Big spans are written straight from the mapping in slices of this
+// size, so the progress moves while they are written
+#define FILE_SAVER_MAX_WRITE (16 * 1024 * 1024)
+
+typedef struct {
+    File_Saver *saver;
+    const Piece_Table *pt;
+} Save_Snapshot;
+
+static double file_saver_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void file_saver_push_span(File_Saver *saver, Save_Span span)
+{
+    if (span.size == 0) {
+        return;
+    }
+
+    // Rows that follow each other in the same buffer become one write
+    if (saver->span_count > 0) {
+        Save_Span *last = &saver->spans[saver->span_count - 1];
+        if (last->added == span.added && last->offset + last->size == span.offset) {
+            last->size += span.size;
+            return;
+        }
+    }
+
+    if (saver->span_count >= saver->span_capacity) {
+        saver->span_capacity = saver->span_capacity == 0 ? 256 : saver->span_capacity * 2;
+        saver->spans = realloc(saver->spans, saver->span_capacity * sizeof(saver->spans[0]));
+        assert(saver->spans != NULL);
+    }
+    saver->spans[saver->span_count++] = span;
+}
+
+static void file_saver_copy_added(File_Saver *saver, const char *text, size_t size)
+{
+    if (saver->added_capacity - saver->added_size < size) {
+        size_t new_capacity = saver->added_capacity == 0 ? 4096 : saver->added_capacity;
+        while (new_capacity - saver->added_size < size) {
+            new_capacity *= 2;
+        }
+        saver->added_text = realloc(saver->added_text, new_capacity);
+        assert(saver->added_text != NULL);
+        saver->added_capacity = new_capacity;
+    }
+    memcpy(saver->added_text + saver->added_size, text, size);
+    saver->added_size += size;
+}
+
+static void file_saver_snapshot_piece(Piece piece, size_t bytes, void *data)
+{
+    Save_Snapshot *snapshot = data;
+    File_Saver *saver = snapshot->saver;
+    const Piece_Table *pt = snapshot->pt;
+
+    if (piece.source == PIECE_ORIGINAL) {
+        file_saver_push_span(saver, (Save_Span) {
+            .offset = pt->original_starts[piece.start],
+            .size = bytes,
+        });
+        return;
+    }
+
+    const Line *line = &pt->added[piece.start];
+    const size_t offset = saver->added_size;
+    size_t size = 0;
+    const char *text = line_text_before_gap(line, &size);
+    file_saver_copy_added(saver, text, size);
+    text = line_text_after_gap(line, &size);
+    file_saver_copy_added(saver, text, size);
+    // Written back as the row ended when it was loaded
+    text = line_ending_text(pt->added_endings[piece.start], &size);
+    assert(bytes == line->size + size);
+    file_saver_copy_added(saver, text, size);
+    file_saver_push_span(saver, (Save_Span) {
+        .added = true,
+        .offset = offset,
+        .size = bytes,
+    });
+}
+
+static bool file_saver_write_all(File_Saver *saver, int fd, const char *data, size_t size)
+{
+    while (size > 0) {
+        const ssize_t n = write(fd, data, size < FILE_SAVER_MAX_WRITE ? size : FILE_SAVER_MAX_WRITE);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+
+        pthread_mutex_lock(&saver->mutex);
+        saver->stats.bytes_written += n;
+        pthread_mutex_unlock(&saver->mutex);
+    }
+    return true;
+}
+
+static bool file_saver_flush(File_Saver *saver, int fd)
+{
+    const bool ok = file_saver_write_all(saver, fd, saver->buffer, saver->buffer_size);
+    saver->buffer_size = 0;
+    return ok;
+}
+
+// Small spans are gathered into the buffer, big ones skip it
+static bool file_saver_write(File_Saver *saver, int fd, const char *data, size_t size)
+{
+    if (saver->buffer_size + size > FILE_SAVER_BUFFER_SIZE) {
+        if (!file_saver_flush(saver, fd)) return false;
+    }
+    if (size >= FILE_SAVER_BUFFER_SIZE) {
+        return file_saver_write_all(saver, fd, data, size);
+    }
+    memcpy(saver->buffer + saver->buffer_size, data, size);
+    saver->buffer_size += size;
+    return true;
+}
+
+// Make the rename itself durable
+static void file_saver_sync_dir(const char *file_path)
+{
+    const char *slash = strrchr(file_path, '/');
+    char *dir = slash ? strndup(file_path, slash == file_path ? 1 : (size_t) (slash - file_path)) : strdup(".");
+    assert(dir != NULL);
+    const int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+static bool file_saver_write_file(File_Saver *saver)
+{
+    TRACE_FUNCTION();
+    const int fd = mkstemp(saver->temp_path);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not create %s: %s\n", saver->temp_path, strerror(errno));
+        return false;
+    }
+
+    // Keep the permissions of the file being replaced
+    struct stat st;
+    fchmod(fd, stat(saver->file_path, &st) == 0 ? st.st_mode & 07777 : 0644);
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < saver->span_count; ++i) {
+        const Save_Span span = saver->spans[i];
+        const char *base = span.added ? saver->added_text : saver->original;
+        ok = file_saver_write(saver, fd, base + span.offset, span.size);
+    }
+    ok = ok && file_saver_flush(saver, fd);
+    ok = ok && fsync(fd) == 0;
+    if (close(fd) < 0) ok = false;
+    ok = ok && rename(saver->temp_path, saver->file_path) == 0;
+
+    if (!ok) {
+        fprintf(stderr, "ERROR: could not save file %s: %s\n", saver->file_path, strerror(errno));
+        unlink(saver->temp_path);
+        return false;
+    }
+
+    file_saver_sync_dir(saver->file_path);
+    return true;
+}
+
+static void *file_saver_run(void *arg)
+{
+    File_Saver *saver = arg;
+    TRACE_THREAD_NAME("file saver");
+
+    const double start = file_saver_now();
+    const bool ok = file_saver_write_file(saver);
+    const double elapsed = file_saver_now() - start;
+
+    pthread_mutex_lock(&saver->mutex);
+    saver->stats.ok = ok;
+    saver->stats.write_secs = elapsed;
+    saver->stats.bytes_per_sec = elapsed > 0 ? saver->stats.bytes_written / elapsed : 0;
+    saver->done = true;
+    pthread_mutex_unlock(&saver->mutex);
+    return NULL;
+}
+
+// Snapshot `pt` and start writing it to `file_path` in the background.
+// The saver must not be active.
+void file_saver_start(File_Saver *saver, const Piece_Table *pt, const char *file_path)
+{
+    TRACE_FUNCTION();
+    assert(!saver->active);
+    const double start = file_saver_now();
+
+    *saver = (File_Saver) {
+        .active = true,
+        .original = pt->original,
+    };
+    pthread_mutex_init(&saver->mutex, NULL);
+
+    const size_t path_size = strlen(file_path);
+    saver->file_path = strdup(file_path);
+    saver->temp_path = malloc(path_size + sizeof(".XXXXXX"));
+    assert(saver->file_path != NULL && saver->temp_path != NULL);
+    memcpy(saver->temp_path, file_path, path_size);
+    memcpy(saver->temp_path + path_size, ".XXXXXX", sizeof(".XXXXXX"));
+
+    Save_Snapshot snapshot = {
+        .saver = saver,
+        .pt = pt,
+    };
+    line_index_visit(&pt->index, file_saver_snapshot_piece, &snapshot);
+
+    // Text the loader has not indexed yet ends up at the end of the document
+    if (pt->original_starts != NULL) {
+        file_saver_push_span(saver, (Save_Span) {
+            .offset = pt->original_end,
+            .size = pt->original_size - pt->original_end,
+        });
+    }
+
+    for (size_t i = 0; i < saver->span_count; ++i) {
+        saver->stats.bytes_total += saver->spans[i].size;
+    }
+    saver->buffer = malloc(FILE_SAVER_BUFFER_SIZE);
+    assert(saver->buffer != NULL);
+
+    saver->stats.stall_secs = file_saver_now() - start;
+    saver->running = pthread_create(&saver->thread, NULL, file_saver_run, saver) == 0;
+    if (!saver->running) {
+        file_saver_run(saver);
+    }
+}
+
+bool file_saver_done(File_Saver *saver)
+{
+    if (!saver->active) {
+        return true;
+    }
+
+    pthread_mutex_lock(&saver->mutex);
+    const bool done = saver->done;
+    pthread_mutex_unlock(&saver->mutex);
+    return done;
+}
+
+Save_Stats file_saver_stats(File_Saver *saver)
+{
+    if (!saver->active) {
+        return saver->stats;
+    }
+
+    pthread_mutex_lock(&saver->mutex);
+    const Save_Stats stats = saver->stats;
+    pthread_mutex_unlock(&saver->mutex);
+    return stats;
+}
+
+// Block until the save finishes and release the snapshot. The stats of
+// the finished save stay available.
+void file_saver_wait(File_Saver *saver)
+{
+    if (!saver->active) {
+        return;
+    }
+
+    if (saver->running) {
+        pthread_join(saver->thread, NULL);
+    }
+    pthread_mutex_destroy(&saver->mutex);
+    free(saver->file_path);
+    free(saver->temp_path);
+    free(saver->spans);
+    free(saver->added_text);
+    free(saver->buffer);
+
+    const Save_Stats stats = saver->stats;
+    *saver = (File_Saver) {
+        .stats = stats,
+    };
+}
@@ -0,0 +1,65 @@
+#ifndef FILE_SAVER_H_
+#define FILE_SAVER_H_
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "./piece_table.h"
+
+#define FILE_SAVER_BUFFER_SIZE (1024 * 1024)
+
+// A run of document bytes, either in the original text or in the copy
+// of the edited rows taken when the save started
+typedef struct {
+    bool added;
+    size_t offset;
+    size_t size;
+} Save_Span;
+
+typedef struct {
+    bool ok;
+    size_t bytes_total;
+    size_t bytes_written;
+    // Time the caller was blocked taking the snapshot
+    double stall_secs;
+    // Time the background thread took from creating the temp file to
+    // renaming it over the target
+    double write_secs;
+    double bytes_per_sec;
+} Save_Stats;
+
+// Saves a snapshot of a document on a background thread. The snapshot
+// refers to untouched rows in place and copies only the edited ones, so
+// the document can keep changing while it is written out. The text goes
+// to a temp file next to the target which is fsynced and renamed over it,
+// so the target always holds either the old or the new contents.
+// The original text the document was loaded from must stay mapped until
+// file_saver_wait returns.
+typedef struct {
+    bool active;
+    bool running;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+
+    char *file_path;
+    char *temp_path;
+    const char *original;
+    Save_Span *spans;
+    size_t span_count;
+    size_t span_capacity;
+    char *added_text;
+    size_t added_size;
+    size_t added_capacity;
+    char *buffer;
+    size_t buffer_size;
+
+    // Guarded by mutex
+    bool done;
+    Save_Stats stats;
+} File_Saver;
+
+void file_saver_start(File_Saver *saver, const Piece_Table *pt, const char *file_path);
+bool file_saver_done(File_Saver *saver);
+Save_Stats file_saver_stats(File_Saver *saver);
+void file_saver_wait(File_Saver *saver);
+
+#endif // FILE_SAVER_H_
@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+#include "./glyph_atlas.h"
+#include "./trace.h"
+
+#define GLYPH_ATLAS_MIN_BUCKETS 1024
+
+struct Atlas_Entry {
+    uint32_t codepoint;
+    int size;
+    Atlas_Glyph glyph;
+    // Next entry in the same bucket, or the next free entry
+    int next;
+};
+
+static unsigned char *read_entire_file(const char *file_path, size_t *size)
+{
+    FILE *file = fopen(file_path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open %s: %s\n", file_path, strerror(errno));
+        return NULL;
+    }
+
+    size_t capacity = 64 * 1024;
+    unsigned char *data = malloc(capacity);
+    assert(data != NULL);
+    *size = 0;
+    size_t n = 0;
+    while ((n = fread(data + *size, 1, capacity - *size, file)) > 0) {
+        *size += n;
+        if (*size == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+            assert(data != NULL);
+        }
+    }
+    if (ferror(file)) {
+        fprintf(stderr, "ERROR: could not read %s: %s\n", file_path, strerror(errno));
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+// Copy `coverage` to `rect` of a page as white with that alpha, so the
+// vertex colors tint the glyphs. NULL coverage clears the rect.
+static void glyph_atlas_upload(Atlas_Page *page, SDL_Rect rect, const unsigned char *coverage)
+{
+    if (rect.w <= 0 || rect.h <= 0) return;
+
+    Uint32 *rgba = malloc((size_t) rect.w * rect.h * sizeof(rgba[0]));
+    assert(rgba != NULL);
+    for (size_t i = 0; i < (size_t) rect.w * rect.h; ++i) {
+        rgba[i] = 0xffffff00 | (coverage ? coverage[i] : 0);
+    }
+    if (SDL_UpdateTexture(page->texture, &rect, rgba, rect.w * sizeof(rgba[0])) < 0) {
+        fprintf(stderr, "ERROR: could not update the glyph atlas: %s\n", SDL_GetError());
+    }
+    free(rgba);
+}
+
+static void glyph_atlas_clear_page(Atlas_Page *page)
+{
+    page->shelf_x = 0;
+    page->shelf_y = 0;
+    page->shelf_height = 0;
+    // Filtering at the edge of a glyph must not pick up an old one
+    glyph_atlas_upload(page, (SDL_Rect) { 0, 0, GLYPH_ATLAS_PAGE_SIZE, GLYPH_ATLAS_PAGE_SIZE }, NULL);
+}
+
+static bool glyph_atlas_add_page(Glyph_Atlas *atlas)
+{
+    assert(atlas->page_count < GLYPH_ATLAS_MAX_PAGES);
+    Atlas_Page *page = &atlas->pages[atlas->page_count];
+    *page = (Atlas_Page) {0};
+    page->texture = SDL_CreateTexture(atlas->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STATIC,
+                                      GLYPH_ATLAS_PAGE_SIZE, GLYPH_ATLAS_PAGE_SIZE);
+    if (page->texture == NULL) {
+        fprintf(stderr, "ERROR: could not create a glyph atlas page: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+    glyph_atlas_clear_page(page);
+    atlas->current_page = atlas->page_count++;
+    return true;
+}
+
+bool glyph_atlas_open(Glyph_Atlas *atlas, SDL_Renderer *renderer, const char *file_path, bool cp437_slots)
+{
+    *atlas = (Glyph_Atlas) {0};
+    atlas->free_entries = -1;
+    atlas->cp437_slots = cp437_slots;
+
+    size_t size = 0;
+    atlas->file_data = read_entire_file(file_path, &size);
+    if (atlas->file_data == NULL) {
+        return false;
+    }
+    atlas->font_hash = glyph_baker_hash(atlas->file_data, size);
+    if (!ttf_init(&atlas->ttf, atlas->file_data, size)) {
+        fprintf(stderr, "ERROR: %s is not a TrueType font ted can read\n", file_path);
+        glyph_atlas_free(atlas);
+        return false;
+    }
+    // Characters the font does not have are drawn as '?'
+    atlas->fallback_glyph = ttf_glyph_index(&atlas->ttf, '?');
+
+    atlas->bucket_count = GLYPH_ATLAS_MIN_BUCKETS;
+    atlas->buckets = malloc(atlas->bucket_count * sizeof(atlas->buckets[0]));
+    assert(atlas->buckets != NULL);
+    memset(atlas->buckets, -1, atlas->bucket_count * sizeof(atlas->buckets[0]));
+
+    atlas->renderer = renderer;
+    if (!glyph_atlas_add_page(atlas)) {
+        glyph_atlas_free(atlas);
+        return false;
+    }
+    return true;
+}
+
+static void glyph_atlas_baker_ready(void *data)
+{
+    const Glyph_Atlas *atlas = data;
+    if (atlas->ready_event != 0) {
+        SDL_Event event = { .type = atlas->ready_event };
+        SDL_PushEvent(&event);
+    }
+}
+
+// Bake the common glyphs of `size` ahead, as many as fit in
+// GLYPH_ATLAS_PREBAKE_PAGES pages when each takes a whole cell
+static void glyph_atlas_prebake(Glyph_Atlas *atlas, const Atlas_Size *size)
+{
+    const size_t cell = (size_t) (size->advance + 1) * (size->pixel_height + 1);
+    size_t room = (size_t) GLYPH_ATLAS_PREBAKE_PAGES * GLYPH_ATLAS_PAGE_SIZE * GLYPH_ATLAS_PAGE_SIZE / cell;
+    uint32_t last = GLYPH_ATLAS_PREBAKE_FIRST;
+    for (; last < GLYPH_ATLAS_PREBAKE_LAST; ++last) {
+        if (glyph_baker_glyph_index(&atlas->ttf, atlas->cp437_slots, last) == 0) continue;
+        if (room == 0) break;
+        room -= 1;
+    }
+    if (last == GLYPH_ATLAS_PREBAKE_FIRST) {
+        return;
+    }
+
+    glyph_baker_start(&atlas->baker, &atlas->ttf, atlas->cp437_slots, atlas->font_hash, size->pixel_height, size->scale,
+                      GLYPH_ATLAS_PREBAKE_FIRST, last, glyph_atlas_baker_ready, atlas);
+}
+
+static Atlas_Size *glyph_atlas_find_size(Glyph_Atlas *atlas, int pixel_height)
+{
+    // Every glyph of a frame is drawn at the same size
+    if (atlas->last_size < atlas->size_count && atlas->sizes[atlas->last_size].pixel_height == pixel_height) {
+        return &atlas->sizes[atlas->last_size];
+    }
+    for (size_t i = 0; i < atlas->size_count; ++i) {
+        if (atlas->sizes[i].pixel_height == pixel_height) {
+            atlas->last_size = i;
+            return &atlas->sizes[i];
+        }
+    }
+
+    atlas->sizes = realloc(atlas->sizes, (atlas->size_count + 1) * sizeof(atlas->sizes[0]));
+    assert(atlas->sizes != NULL);
+    atlas->last_size = atlas->size_count;
+    Atlas_Size *size = &atlas->sizes[atlas->size_count++];
+    size->pixel_height = pixel_height;
+    size->scale = ttf_scale_for_height(&atlas->ttf, pixel_height);
+    size->ascent = (int) roundf(atlas->ttf.ascent * size->scale);
+
+    // ted lays text out in a grid, so the cell is as wide as an 'M'
+    int advance = 0;
+    int left_bearing = 0;
+    ttf_glyph_metrics(&atlas->ttf, ttf_glyph_index(&atlas->ttf, 'M'), &advance, &left_bearing);
+    size->advance = (int) roundf(advance * size->scale);
+    if (size->advance < 1) size->advance = 1;
+
+    // Other sizes come from zooming, which only needs what is on screen
+    if (atlas->size_count == 1) {
+        glyph_atlas_prebake(atlas, size);
+    }
+    return size;
+}
+
+// Metrics of the font at `pixel_height`. The pointer is good until the
+// next size is added.
+const Atlas_Size *glyph_atlas_size(Glyph_Atlas *atlas, int pixel_height)
+{
+    return glyph_atlas_find_size(atlas, pixel_height);
+}
+
+static int *glyph_atlas_bucket(Glyph_Atlas *atlas, uint32_t codepoint, int size)
+{
+    uint64_t h = ((uint64_t) size << 32 | codepoint) * 0x9e3779b97f4a7c15ull;
+    return &atlas->buckets[(h ^ (h >> 32)) & (atlas->bucket_count - 1)];
+}
+
+static void glyph_atlas_rehash(Glyph_Atlas *atlas, size_t bucket_count)
+{
+    int *old = atlas->buckets;
+    const size_t old_count = atlas->bucket_count;
+    atlas->buckets = malloc(bucket_count * sizeof(atlas->buckets[0]));
+    assert(atlas->buckets != NULL);
+    memset(atlas->buckets, -1, bucket_count * sizeof(atlas->buckets[0]));
+    atlas->bucket_count = bucket_count;
+
+    for (size_t b = 0; b < old_count; ++b) {
+        int i = old[b];
+        while (i >= 0) {
+            Atlas_Entry *entry = &atlas->entries[i];
+            const int next = entry->next;
+            int *bucket = glyph_atlas_bucket(atlas, entry->codepoint, entry->size);
+            entry->next = *bucket;
+            *bucket = i;
+            i = next;
+        }
+    }
+    free(old);
+}
+
+static void glyph_atlas_insert(Glyph_Atlas *atlas, uint32_t codepoint, int size, Atlas_Glyph glyph)
+{
+    if (atlas->glyph_count >= atlas->bucket_count) {
+        glyph_atlas_rehash(atlas, atlas->bucket_count * 2);
+    }
+
+    int i = atlas->free_entries;
+    if (i >= 0) {
+        atlas->free_entries = atlas->entries[i].next;
+    } else {
+        if (atlas->entry_count >= atlas->entry_capacity) {
+            atlas->entry_capacity = atlas->entry_capacity == 0 ? 256 : atlas->entry_capacity * 2;
+            atlas->entries = realloc(atlas->entries, atlas->entry_capacity * sizeof(atlas->entries[0]));
+            assert(atlas->entries != NULL);
+        }
+        i = atlas->entry_count++;
+    }
+
+    int *bucket = glyph_atlas_bucket(atlas, codepoint, size);
+    atlas->entries[i] = (Atlas_Entry) {
+        .codepoint = codepoint,
+        .size = size,
+        .glyph = glyph,
+        .next = *bucket,
+    };
+    *bucket = i;
+    atlas->glyph_count += 1;
+}
+
+// Forget every glyph on `page` and clear it for new ones
+static void glyph_atlas_evict(Glyph_Atlas *atlas, size_t page)
+{
+    for (size_t b = 0; b < atlas->bucket_count; ++b) {
+        int *link = &atlas->buckets[b];
+        while (*link >= 0) {
+            Atlas_Entry *entry = &atlas->entries[*link];
+            if (entry->glyph.page == (int) page) {
+                const int i = *link;
+                *link = entry->next;
+                entry->next = atlas->free_entries;
+                atlas->free_entries = i;
+                atlas->glyph_count -= 1;
+            } else {
+                link = &entry->next;
+            }
+        }
+    }
+    glyph_atlas_clear_page(&atlas->pages[page]);
+    atlas->current_page = page;
+    atlas->stats.evictions += 1;
+}
+
+// Make room for a `w` by `h` glyph on the current page, moving on to a
+// new or evicted page once it is full. Returns false if every page has
+// glyphs waiting to be drawn.
+static bool glyph_atlas_reserve(Glyph_Atlas *atlas, int w, int h, SDL_Rect *rect)
+{
+    Atlas_Page *page = &atlas->pages[atlas->current_page];
+    // One pixel of padding keeps filtering from bleeding between glyphs
+    if (page->shelf_x + w + 1 > GLYPH_ATLAS_PAGE_SIZE) {
+        page->shelf_y += page->shelf_height;
+        page->shelf_x = 0;
+        page->shelf_height = 0;
+    }
+
+    if (page->shelf_y + h + 1 > GLYPH_ATLAS_PAGE_SIZE) {
+        if (atlas->page_count < GLYPH_ATLAS_MAX_PAGES && glyph_atlas_add_page(atlas)) {
+            page = &atlas->pages[atlas->current_page];
+        } else {
+            size_t victim = GLYPH_ATLAS_MAX_PAGES;
+            for (size_t i = 0; i < atlas->page_count; ++i) {
+                if (!atlas->pages[i].pending &&
+                    (victim == GLYPH_ATLAS_MAX_PAGES || atlas->pages[i].last_used < atlas->pages[victim].last_used)) {
+                    victim = i;
+                }
+            }
+            if (victim == GLYPH_ATLAS_MAX_PAGES) {
+                return false;
+            }
+            glyph_atlas_evict(atlas, victim);
+            page = &atlas->pages[victim];
+        }
+    }
+
+    *rect = (SDL_Rect) { page->shelf_x, page->shelf_y, w, h };
+    page->shelf_x += w + 1;
+    if (h + 1 > page->shelf_height) page->shelf_height = h + 1;
+    return true;
+}
+
+// Put `baked` on a page. Returns false if every page has glyphs waiting
+// to be drawn.
+static bool glyph_atlas_place(Glyph_Atlas *atlas, const Atlas_Size *size, const Baked_Glyph *baked, Atlas_Glyph *glyph)
+{
+    *glyph = (Atlas_Glyph) { .page = -1 };
+
+    // Blank glyphs get an entry too, so they are only looked at once
+    if (baked->coverage == NULL ||
+        baked->w + 1 > GLYPH_ATLAS_PAGE_SIZE || baked->h + 1 > GLYPH_ATLAS_PAGE_SIZE) {
+        return true;
+    }
+
+    SDL_Rect rect = {0};
+    if (!glyph_atlas_reserve(atlas, baked->w, baked->h, &rect)) {
+        return false;
+    }
+    glyph_atlas_upload(&atlas->pages[atlas->current_page], rect, baked->coverage);
+
+    glyph->rect = rect;
+    glyph->page = atlas->current_page;
+    glyph->x_offset = baked->x0;
+    glyph->y_offset = size->ascent + baked->y0;
+    return true;
+}
+
+static bool glyph_atlas_bake(Glyph_Atlas *atlas, const Atlas_Size *size, uint32_t codepoint, Atlas_Glyph *glyph)
+{
+    int index = glyph_baker_glyph_index(&atlas->ttf, atlas->cp437_slots, codepoint);
+    if (index == 0) index = atlas->fallback_glyph;
+
+    Baked_Glyph baked;
+    glyph_baker_rasterize(&atlas->ttf, codepoint, index, size->scale, &baked);
+    const bool placed = glyph_atlas_place(atlas, size, &baked, glyph);
+    free(baked.coverage);
+    return placed;
+}
+
+static const Atlas_Entry *glyph_atlas_find(Glyph_Atlas *atlas, uint32_t codepoint, int size_index)
+{
+    for (int i = *glyph_atlas_bucket(atlas, codepoint, size_index); i >= 0; i = atlas->entries[i].next) {
+        const Atlas_Entry *entry = &atlas->entries[i];
+        if (entry->codepoint == codepoint && entry->size == size_index) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static const Atlas_Glyph *glyph_atlas_use(Glyph_Atlas *atlas, const Atlas_Glyph *glyph)
+{
+    if (glyph->page >= 0) {
+        atlas->pages[glyph->page].last_used = ++atlas->clock;
+        atlas->pages[glyph->page].pending = true;
+    }
+    return glyph;
+}
+
+// The glyph of `codepoint` at `pixel_height`, baking it on first use.
+// Returns NULL for a glyph that is not baked yet once the frame has used
+// up its rasterizing budget, while every page is waiting to be drawn, or
+// while the baker still has it coming, which makes the baker do it next;
+// it is there on a later frame. The pointer is good until the next call.
+const Atlas_Glyph *glyph_atlas_get(Glyph_Atlas *atlas, uint32_t codepoint, int pixel_height)
+{
+    const Atlas_Size *size = glyph_atlas_find_size(atlas, pixel_height);
+    const int size_index = size - atlas->sizes;
+    if (atlas->deterministic && glyph_baker_pending(&atlas->baker, pixel_height, codepoint)) {
+        glyph_atlas_wait(atlas);
+    }
+    const Atlas_Entry *entry = glyph_atlas_find(atlas, codepoint, size_index);
+    if (entry != NULL) {
+        return glyph_atlas_use(atlas, &entry->glyph);
+    }
+
+    if (glyph_baker_pending(&atlas->baker, pixel_height, codepoint)) {
+        // Baked but not taken yet, or else baked next
+        if (glyph_baker_want(&atlas->baker, codepoint)) {
+            atlas->frame_deferred = true;
+        }
+        atlas->stats.deferred += 1;
+        return NULL;
+    }
+    if (atlas->frame_secs >= GLYPH_ATLAS_FRAME_BUDGET_SECS && !atlas->deterministic) {
+        atlas->frame_deferred = true;
+        atlas->stats.deferred += 1;
+        return NULL;
+    }
+    const Uint64 start = SDL_GetPerformanceCounter();
+    Atlas_Glyph glyph = {0};
+    const bool baked = glyph_atlas_bake(atlas, size, codepoint, &glyph);
+    atlas->frame_secs += (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    if (!baked) {
+        atlas->frame_deferred = true;
+        atlas->stats.deferred += 1;
+        return NULL;
+    }
+
+    glyph_atlas_insert(atlas, codepoint, size_index, glyph);
+    atlas->stats.baked += 1;
+    return glyph_atlas_use(atlas, &atlas->entries[*glyph_atlas_bucket(atlas, codepoint, size_index)].glyph);
+}
+
+// Place the glyphs the baker has finished, until the frame's budget is
+// used up. The rest are placed on the next frames.
+static void glyph_atlas_take_baked(Glyph_Atlas *atlas)
+{
+    TRACE_FUNCTION();
+    Glyph_Baker *baker = &atlas->baker;
+    const bool done = glyph_baker_done(baker);
+    size_t count = 0;
+    Baked_Glyph *baked = glyph_baker_take(baker, &count);
+    if (count > 0) {
+        atlas->queued = realloc(atlas->queued, (atlas->queued_count + count) * sizeof(atlas->queued[0]));
+        assert(atlas->queued != NULL);
+        memcpy(atlas->queued + atlas->queued_count, baked, count * sizeof(baked[0]));
+        atlas->queued_count += count;
+    }
+    free(baked);
+
+    size_t size_index = 0;
+    while (size_index < atlas->size_count && atlas->sizes[size_index].pixel_height != baker->pixel_height) {
+        size_index += 1;
+    }
+    assert(atlas->queued_next == atlas->queued_count || size_index < atlas->size_count);
+
+    const Uint64 start = SDL_GetPerformanceCounter();
+    const Uint64 budget = (Uint64) (GLYPH_ATLAS_FRAME_BUDGET_SECS * SDL_GetPerformanceFrequency());
+    while (atlas->queued_next < atlas->queued_count) {
+        if (!atlas->deterministic && SDL_GetPerformanceCounter() - start >= budget) {
+            atlas->frame_deferred = true;
+            break;
+        }
+        const Baked_Glyph *glyph = &atlas->queued[atlas->queued_next];
+        if (glyph_atlas_find(atlas, glyph->codepoint, (int) size_index) == NULL) {
+            Atlas_Glyph placed = {0};
+            // Every page is waiting to be drawn
+            if (!glyph_atlas_place(atlas, &atlas->sizes[size_index], glyph, &placed)) {
+                atlas->frame_deferred = true;
+                break;
+            }
+            glyph_atlas_insert(atlas, glyph->codepoint, (int) size_index, placed);
+            atlas->stats.prebaked += 1;
+        }
+        atlas->queued_next += 1;
+    }
+    atlas->frame_secs += (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    // Everything is placed, so the baker's copies can go
+    if (done && atlas->queued_next == atlas->queued_count) {
+        if (baker->from_cache) atlas->stats.cached_sizes += 1;
+        glyph_baker_stop(baker);
+        free(atlas->queued);
+        atlas->queued = NULL;
+        atlas->queued_count = 0;
+        atlas->queued_next = 0;
+    }
+}
+
+// Wait for the baker and place everything it baked
+void glyph_atlas_wait(Glyph_Atlas *atlas)
+{
+    if (atlas->baker.active) {
+        glyph_baker_wait(&atlas->baker);
+        glyph_atlas_take_baked(atlas);
+    }
+}
+
+// Start the rasterizing budget of a new frame
+void glyph_atlas_begin_frame(Glyph_Atlas *atlas)
+{
+    atlas->frame_secs = 0.0;
+    atlas->frame_deferred = false;
+    if (atlas->baker.active) {
+        glyph_atlas_take_baked(atlas);
+    }
+}
+
+// Called once the queued glyphs are drawn, so their pages can be evicted
+void glyph_atlas_drawn(Glyph_Atlas *atlas)
+{
+    for (size_t i = 0; i < atlas->page_count; ++i) {
+        atlas->pages[i].pending = false;
+    }
+}
+
+void glyph_atlas_free(Glyph_Atlas *atlas)
+{
+    glyph_baker_stop(&atlas->baker);
+    free(atlas->queued);
+    for (size_t i = 0; i < atlas->page_count; ++i) {
+        SDL_DestroyTexture(atlas->pages[i].texture);
+    }
+    free(atlas->sizes);
+    free(atlas->entries);
+    free(atlas->buckets);
+    free(atlas->file_data);
+    *atlas = (Glyph_Atlas) {0};
+}
@@ -0,0 +1,121 @@
+#ifndef GLYPH_ATLAS_H_
+#define GLYPH_ATLAS_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+#include "./ttf.h"
+#include "./glyph_baker.h"
+
+#define GLYPH_ATLAS_PAGE_SIZE 512
+#define GLYPH_ATLAS_MAX_PAGES 8
+// Time a frame may spend rasterizing; later new glyphs wait a frame
+#define GLYPH_ATLAS_FRAME_BUDGET_SECS 0.004
+// Codepoints baked ahead on worker threads at the first size drawn, as
+// many of them as fill GLYPH_ATLAS_PREBAKE_PAGES pages
+#define GLYPH_ATLAS_PREBAKE_FIRST 0x20
+#define GLYPH_ATLAS_PREBAKE_LAST 0x2600
+#define GLYPH_ATLAS_PREBAKE_PAGES 4
+
+// Where a baked glyph sits in its page, and where to draw it relative to
+// the top left corner of its cell. Blank glyphs have an empty rect.
+typedef struct {
+    SDL_Rect rect;
+    int page;
+    int x_offset;
+    int y_offset;
+} Atlas_Glyph;
+
+// Metrics of the font at one pixel size
+typedef struct {
+    int pixel_height;
+    float scale;
+    int ascent;
+    int advance;
+} Atlas_Size;
+
+typedef struct {
+    SDL_Texture *texture;
+    int shelf_x;
+    int shelf_y;
+    int shelf_height;
+    uint64_t last_used;
+    // Glyphs from the page are queued but not drawn yet, so it cannot be
+    // evicted until glyph_atlas_drawn
+    bool pending;
+} Atlas_Page;
+
+typedef struct {
+    size_t baked;
+    size_t deferred;
+    size_t evictions;
+    // Glyphs that came from the baker, and sizes it read from the cache
+    size_t prebaked;
+    size_t cached_sizes;
+} Glyph_Atlas_Stats;
+
+typedef struct Atlas_Entry Atlas_Entry;
+
+// TrueType glyphs rasterized on first use at the exact pixel size they
+// are drawn at, packed in shelves into fixed size texture pages. Glyphs
+// are found through a hash of (codepoint, size), so any codepoint works
+// without a table per size. Once every page is full the least recently
+// used one is cleared for reuse, and the glyphs on it are baked again
+// when next drawn. The common ranges of the first size are baked ahead
+// by `baker` and placed as they arrive, within the frame budget.
+typedef struct {
+    unsigned char *file_data;
+    Ttf_Font ttf;
+    // The font is drawn as code page 437, see glyph_baker_glyph_index
+    bool cp437_slots;
+    uint64_t font_hash;
+    int fallback_glyph;
+    Glyph_Baker baker;
+    // Taken from the baker but not placed yet
+    Baked_Glyph *queued;
+    size_t queued_count;
+    size_t queued_next;
+    // SDL event pushed when a glyph that was asked for comes from the
+    // baker, if not 0. Set before the first glyph is asked for.
+    Uint32 ready_event;
+
+    SDL_Renderer *renderer;
+    Atlas_Page pages[GLYPH_ATLAS_MAX_PAGES];
+    size_t page_count;
+    size_t current_page;
+    uint64_t clock;
+
+    Atlas_Size *sizes;
+    size_t size_count;
+    size_t last_size;
+
+    // Hash of (codepoint, size index) to entries chained through their
+    // `next`. Entries of evicted glyphs go on the free list.
+    Atlas_Entry *entries;
+    size_t entry_count;
+    size_t entry_capacity;
+    int free_entries;
+    int *buckets;
+    size_t bucket_count;
+    size_t glyph_count;
+
+    double frame_secs;
+    // Some glyphs of this frame were left for the next one, which can
+    // draw them without waiting for the baker
+    bool frame_deferred;
+    // Every glyph is drawn on the first frame that asks for it, waiting
+    // for the baker and ignoring the frame budget, so the frames do not
+    // depend on timing
+    bool deterministic;
+    Glyph_Atlas_Stats stats;
+} Glyph_Atlas;
+
+bool glyph_atlas_open(Glyph_Atlas *atlas, SDL_Renderer *renderer, const char *file_path, bool cp437_slots);
+const Atlas_Size *glyph_atlas_size(Glyph_Atlas *atlas, int pixel_height);
+const Atlas_Glyph *glyph_atlas_get(Glyph_Atlas *atlas, uint32_t codepoint, int pixel_height);
+void glyph_atlas_begin_frame(Glyph_Atlas *atlas);
+void glyph_atlas_wait(Glyph_Atlas *atlas);
+void glyph_atlas_drawn(Glyph_Atlas *atlas);
+void glyph_atlas_free(Glyph_Atlas *atlas);
+
+#endif // GLYPH_ATLAS_H_
@@ -0,0 +1,505 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "./glyph_baker.h"
+#include "./cp437.h"
+#include "./trace.h"
+
+#define GLYPH_CACHE_MAGIC "TEDGLYF2"
+#define GLYPH_CACHE_MAX_SIDE 4096
+
+// Chunk states, with GLYPH_CHUNK_WANTED added once a glyph of the chunk
+// is wanted
+enum {
+    GLYPH_CHUNK_WAITING,
+    GLYPH_CHUNK_BAKING,
+    GLYPH_CHUNK_BAKED,
+    GLYPH_CHUNK_STATE = 3,
+    GLYPH_CHUNK_WANTED = 4,
+};
+
+// FNV-1a of the font file
+uint64_t glyph_baker_hash(const unsigned char *data, size_t size)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= data[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Glyph of the font that draws `codepoint`, or 0. A font with CP437
+// artwork in its byte slots draws the codepoints CP437 has from the slot
+// of their byte, and only the rest through its cmap.
+int glyph_baker_glyph_index(const Ttf_Font *ttf, bool cp437_slots, uint32_t codepoint)
+{
+    const int byte = cp437_slots ? cp437_from_codepoint(codepoint) : -1;
+    if (byte >= 0) {
+        int glyph = ttf_glyph_index(ttf, cp437_slot_codepoint(byte));
+        // Older fonts leave the Windows-1252 additions at their C1 codepoints
+        if (glyph == 0) glyph = ttf_glyph_index(ttf, byte);
+        if (glyph != 0) return glyph;
+    }
+    return ttf_glyph_index(ttf, codepoint);
+}
+
+// Rasterize `glyph` of the font, which draws `codepoint`. Returns false
+// for blank glyphs, which get no coverage.
+bool glyph_baker_rasterize(const Ttf_Font *ttf, uint32_t codepoint, int glyph, float scale, Baked_Glyph *baked)
+{
+    *baked = (Baked_Glyph) { .codepoint = codepoint };
+    int x0, y0, x1, y1;
+    if (!ttf_glyph_box(ttf, glyph, scale, &x0, &y0, &x1, &y1) ||
+        x1 - x0 > GLYPH_CACHE_MAX_SIDE || y1 - y0 > GLYPH_CACHE_MAX_SIDE) {
+        return false;
+    }
+
+    baked->x0 = x0;
+    baked->y0 = y0;
+    baked->w = x1 - x0;
+    baked->h = y1 - y0;
+    baked->coverage = calloc((size_t) baked->w * baked->h, 1);
+    assert(baked->coverage != NULL);
+    ttf_render_glyph(ttf, glyph, scale, baked->coverage, baked->w, baked->h, baked->w);
+    return true;
+}
+
+static void write_varint(FILE *file, uint64_t value)
+{
+    unsigned char bytes[10];
+    size_t n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        n += 1;
+    } while (value);
+    fwrite(bytes, 1, n, file);
+}
+
+static bool read_varint(const unsigned char *data, size_t size, size_t *pos, uint64_t *value)
+{
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*pos >= size) return false;
+        const unsigned char byte = data[(*pos)++];
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static uint64_t zigzag(int value)
+{
+    return value < 0 ? ((uint64_t) -(int64_t) value << 1) - 1 : (uint64_t) value << 1;
+}
+
+static int unzigzag(uint64_t value)
+{
+    return value & 1 ? -(int) (value >> 1) - 1 : (int) (value >> 1);
+}
+
+// $XDG_CACHE_HOME/ted/glyphs-<font hash>-<size>.bin, or under ~/.cache,
+// creating the directories. NULL if there is nowhere to put it.
+static char *glyph_cache_path(uint64_t font_hash, int pixel_height)
+{
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char dir[4096];
+    if (xdg && *xdg) {
+        snprintf(dir, sizeof(dir), "%s", xdg);
+    } else if (home && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+    } else {
+        return NULL;
+    }
+    mkdir(dir, 0755);
+    strncat(dir, "/ted", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        return NULL;
+    }
+
+    const size_t size = strlen(dir) + 64;
+    char *path = malloc(size);
+    assert(path != NULL);
+    snprintf(path, size, "%s/glyphs-%016llx-%d.bin", dir, (unsigned long long) font_hash, pixel_height);
+    return path;
+}
+
+static void glyph_baker_push(Glyph_Baker *baker, const Baked_Glyph *glyphs, size_t count)
+{
+    if (baker->capacity - baker->count < count) {
+        while (baker->capacity - baker->count < count) {
+            baker->capacity = baker->capacity == 0 ? 256 : baker->capacity * 2;
+        }
+        baker->glyphs = realloc(baker->glyphs, baker->capacity * sizeof(baker->glyphs[0]));
+        assert(baker->glyphs != NULL);
+    }
+    memcpy(baker->glyphs + baker->count, glyphs, count * sizeof(glyphs[0]));
+    baker->count += count;
+}
+
+// Load every glyph of the baker's range and size from its cache file.
+// A file written by another version, or for another font, size or range,
+// is replaced once the glyphs are baked again.
+static bool glyph_cache_load(Glyph_Baker *baker)
+{
+    TRACE_FUNCTION();
+    FILE *file = fopen(baker->cache_path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    size_t capacity = 64 * 1024;
+    unsigned char *data = malloc(capacity);
+    assert(data != NULL);
+    size_t size = 0;
+    size_t n = 0;
+    while ((n = fread(data + size, 1, capacity - size, file)) > 0) {
+        size += n;
+        if (size == capacity) {
+            capacity *= 2;
+            data = realloc(data, capacity);
+            assert(data != NULL);
+        }
+    }
+    fclose(file);
+
+    const size_t magic_size = strlen(GLYPH_CACHE_MAGIC);
+    size_t pos = magic_size;
+    uint64_t version, hash, pixel_height, first, last, count;
+    const bool current = size >= magic_size && memcmp(data, GLYPH_CACHE_MAGIC, magic_size) == 0
+        && read_varint(data, size, &pos, &version) && version == GLYPH_CACHE_VERSION
+        && read_varint(data, size, &pos, &hash) && hash == baker->font_hash
+        && read_varint(data, size, &pos, &pixel_height) && pixel_height == (uint64_t) baker->pixel_height
+        && read_varint(data, size, &pos, &first) && first == baker->first
+        && read_varint(data, size, &pos, &last) && last == baker->last;
+    if (!current) {
+        free(data);
+        return false;
+    }
+
+    bool ok = read_varint(data, size, &pos, &count) && count <= last - first;
+    Baked_Glyph *glyphs = ok ? calloc(count + 1, sizeof(glyphs[0])) : NULL;
+    size_t loaded = 0;
+    for (; ok && loaded < count; ++loaded) {
+        uint64_t codepoint, x0, y0, w, h;
+        ok = read_varint(data, size, &pos, &codepoint) && codepoint >= first && codepoint < last
+            && read_varint(data, size, &pos, &x0)
+            && read_varint(data, size, &pos, &y0)
+            && read_varint(data, size, &pos, &w) && w <= GLYPH_CACHE_MAX_SIDE
+            && read_varint(data, size, &pos, &h) && h <= GLYPH_CACHE_MAX_SIDE
+            && size - pos >= w * h;
+        if (!ok) break;
+
+        Baked_Glyph *glyph = &glyphs[loaded];
+        *glyph = (Baked_Glyph) {
+            .codepoint = codepoint,
+            .x0 = unzigzag(x0),
+            .y0 = unzigzag(y0),
+            .w = w,
+            .h = h,
+        };
+        if (w * h > 0) {
+            glyph->coverage = malloc(w * h);
+            assert(glyph->coverage != NULL);
+            memcpy(glyph->coverage, data + pos, w * h);
+            pos += w * h;
+        }
+    }
+    ok = ok && pos == size;
+
+    if (ok) {
+        glyph_baker_push(baker, glyphs, count);
+    } else {
+        fprintf(stderr, "WARNING: ignoring the damaged glyph cache %s\n", baker->cache_path);
+        for (size_t i = 0; glyphs && i < loaded; ++i) {
+            free(glyphs[i].coverage);
+        }
+    }
+    free(glyphs);
+    free(data);
+    return ok;
+}
+
+// Write the glyphs to a temporary file renamed over the cache, so a
+// launch never reads half a cache
+static void glyph_cache_save(const Glyph_Baker *baker)
+{
+    TRACE_FUNCTION();
+    const size_t size = strlen(baker->cache_path) + 16;
+    char *temp_path = malloc(size);
+    assert(temp_path != NULL);
+    snprintf(temp_path, size, "%s.XXXXXX", baker->cache_path);
+
+    const int fd = mkstemp(temp_path);
+    FILE *file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+    if (file == NULL) {
+        fprintf(stderr, "WARNING: could not write the glyph cache %s: %s\n", baker->cache_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_path);
+        }
+        free(temp_path);
+        return;
+    }
+
+    fwrite(GLYPH_CACHE_MAGIC, 1, strlen(GLYPH_CACHE_MAGIC), file);
+    write_varint(file, GLYPH_CACHE_VERSION);
+    write_varint(file, baker->font_hash);
+    write_varint(file, baker->pixel_height);
+    write_varint(file, baker->first);
+    write_varint(file, baker->last);
+    write_varint(file, baker->count);
+    for (size_t i = 0; i < baker->count; ++i) {
+        const Baked_Glyph *glyph = &baker->glyphs[i];
+        write_varint(file, glyph->codepoint);
+        write_varint(file, zigzag(glyph->x0));
+        write_varint(file, zigzag(glyph->y0));
+        write_varint(file, glyph->w);
+        write_varint(file, glyph->h);
+        if (glyph->coverage) fwrite(glyph->coverage, 1, (size_t) glyph->w * glyph->h, file);
+    }
+
+    const bool ok = !ferror(file) && fclose(file) == 0 && rename(temp_path, baker->cache_path) == 0;
+    if (!ok) {
+        fprintf(stderr, "WARNING: could not write the glyph cache %s: %s\n", baker->cache_path, strerror(errno));
+        unlink(temp_path);
+    }
+    free(temp_path);
+}
+
+// Take the next chunk to bake: the last one wanted, or else the first
+// one still waiting. Returns false if there is none. Called locked.
+static bool glyph_baker_claim(Glyph_Baker *baker, size_t *chunk)
+{
+    while (baker->urgent_count > 0) {
+        *chunk = baker->urgent[--baker->urgent_count];
+        if ((baker->chunks[*chunk] & GLYPH_CHUNK_STATE) == GLYPH_CHUNK_WAITING) {
+            baker->chunks[*chunk] |= GLYPH_CHUNK_BAKING;
+            return true;
+        }
+    }
+    while (baker->next < baker->last) {
+        *chunk = (baker->next - baker->first) / GLYPH_BAKER_CHUNK;
+        baker->next = baker->last - baker->next > GLYPH_BAKER_CHUNK ? baker->next + GLYPH_BAKER_CHUNK : baker->last;
+        if ((baker->chunks[*chunk] & GLYPH_CHUNK_STATE) == GLYPH_CHUNK_WAITING) {
+            baker->chunks[*chunk] |= GLYPH_CHUNK_BAKING;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *glyph_baker_run(void *arg)
+{
+    Glyph_Baker *baker = arg;
+    TRACE_THREAD_NAME("glyph baker");
+
+    for (;;) {
+        pthread_mutex_lock(&baker->mutex);
+        size_t chunk = 0;
+        const bool stop = baker->cancel || !glyph_baker_claim(baker, &chunk);
+        pthread_mutex_unlock(&baker->mutex);
+        if (stop) break;
+
+        const uint32_t begin = baker->first + chunk * GLYPH_BAKER_CHUNK;
+        const uint32_t end = baker->last - begin > GLYPH_BAKER_CHUNK ? begin + GLYPH_BAKER_CHUNK : baker->last;
+
+        TRACE_ZONE("glyph_baker_chunk");
+        Baked_Glyph glyphs[GLYPH_BAKER_CHUNK];
+        size_t count = 0;
+        for (uint32_t codepoint = begin; codepoint < end; ++codepoint) {
+            const int glyph = glyph_baker_glyph_index(baker->ttf, baker->cp437_slots, codepoint);
+            if (glyph == 0) continue;
+            glyph_baker_rasterize(baker->ttf, codepoint, glyph, baker->scale, &glyphs[count++]);
+        }
+
+        pthread_mutex_lock(&baker->mutex);
+        glyph_baker_push(baker, glyphs, count);
+        const bool wanted = baker->chunks[chunk] & GLYPH_CHUNK_WANTED;
+        baker->chunks[chunk] = GLYPH_CHUNK_BAKED;
+        pthread_mutex_unlock(&baker->mutex);
+
+        if (wanted && baker->ready) {
+            baker->ready(baker->ready_data);
+        }
+    }
+
+    // The last worker out saves the whole set
+    pthread_mutex_lock(&baker->mutex);
+    baker->running -= 1;
+    const bool last = baker->running == 0;
+    const bool complete = last && !baker->cancel;
+    pthread_mutex_unlock(&baker->mutex);
+
+    // Nothing adds glyphs any more, so the set can be read unlocked
+    if (complete && baker->cache_path) {
+        glyph_cache_save(baker);
+    }
+    if (last) {
+        pthread_mutex_lock(&baker->mutex);
+        baker->done = true;
+        pthread_mutex_unlock(&baker->mutex);
+    }
+    return NULL;
+}
+
+// Bake codepoints [first, last) at `pixel_height`, from the cache if it
+// has them or on one worker per core otherwise. `ready` may be NULL.
+void glyph_baker_start(Glyph_Baker *baker, const Ttf_Font *ttf, bool cp437_slots, uint64_t font_hash, int pixel_height, float scale,
+                       uint32_t first, uint32_t last, Glyph_Baker_Ready ready, void *ready_data)
+{
+    TRACE_FUNCTION();
+    *baker = (Glyph_Baker) {
+        .ttf = ttf,
+        .cp437_slots = cp437_slots,
+        .font_hash = font_hash,
+        .pixel_height = pixel_height,
+        .scale = scale,
+        .first = first,
+        .last = last,
+        .ready = ready,
+        .ready_data = ready_data,
+        .active = true,
+        .next = first,
+    };
+    pthread_mutex_init(&baker->mutex, NULL);
+
+    baker->cache_path = glyph_cache_path(font_hash, pixel_height);
+    if (baker->cache_path && glyph_cache_load(baker)) {
+        baker->from_cache = true;
+        baker->done = true;
+        return;
+    }
+
+    const size_t chunk_count = (last - first + GLYPH_BAKER_CHUNK - 1) / GLYPH_BAKER_CHUNK;
+    baker->chunks = calloc(chunk_count + 1, sizeof(baker->chunks[0]));
+    baker->urgent = malloc((chunk_count + 1) * sizeof(baker->urgent[0]));
+    assert(baker->chunks != NULL && baker->urgent != NULL);
+
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus < 1 ? 1 : (size_t) cpus;
+    if (threads > GLYPH_BAKER_MAX_THREADS) threads = GLYPH_BAKER_MAX_THREADS;
+
+    pthread_mutex_lock(&baker->mutex);
+    for (size_t i = 0; i < threads; ++i) {
+        if (pthread_create(&baker->threads[baker->thread_count], NULL, glyph_baker_run, baker) != 0) break;
+        baker->thread_count += 1;
+        baker->running += 1;
+    }
+    pthread_mutex_unlock(&baker->mutex);
+
+    if (baker->thread_count == 0) {
+        baker->running = 1;
+        glyph_baker_run(baker);
+    }
+}
+
+// Glyphs baked since the last call. The caller owns the array; the
+// coverage stays with the baker until glyph_baker_stop.
+Baked_Glyph *glyph_baker_take(Glyph_Baker *baker, size_t *count)
+{
+    *count = 0;
+    if (!baker->active) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&baker->mutex);
+    Baked_Glyph *glyphs = NULL;
+    *count = baker->count - baker->taken;
+    if (*count > 0) {
+        glyphs = malloc(*count * sizeof(glyphs[0]));
+        assert(glyphs != NULL);
+        memcpy(glyphs, baker->glyphs + baker->taken, *count * sizeof(glyphs[0]));
+        baker->taken = baker->count;
+    }
+    pthread_mutex_unlock(&baker->mutex);
+    return glyphs;
+}
+
+// Whether the glyph of `codepoint` at `pixel_height` is still on its way.
+// Once the baker is done its glyphs are pending until it is stopped, as
+// they may not have been taken yet.
+bool glyph_baker_pending(Glyph_Baker *baker, int pixel_height, uint32_t codepoint)
+{
+    return baker->active && baker->pixel_height == pixel_height
+        && codepoint >= baker->first && codepoint < baker->last
+        && glyph_baker_glyph_index(baker->ttf, baker->cp437_slots, codepoint) != 0;
+}
+
+// Bake the chunk of `codepoint` next, as it is wanted on screen, and
+// call `ready` once it is baked. Returns true if it is baked already.
+bool glyph_baker_want(Glyph_Baker *baker, uint32_t codepoint)
+{
+    if (!baker->active || codepoint < baker->first || codepoint >= baker->last) {
+        return false;
+    }
+    if (baker->chunks == NULL) {
+        return true;
+    }
+
+    const size_t chunk = (codepoint - baker->first) / GLYPH_BAKER_CHUNK;
+    pthread_mutex_lock(&baker->mutex);
+    const unsigned char state = baker->chunks[chunk];
+    const bool baked = (state & GLYPH_CHUNK_STATE) == GLYPH_CHUNK_BAKED;
+    if (!baked && !(state & GLYPH_CHUNK_WANTED)) {
+        baker->chunks[chunk] |= GLYPH_CHUNK_WANTED;
+        if ((state & GLYPH_CHUNK_STATE) == GLYPH_CHUNK_WAITING) {
+            baker->urgent[baker->urgent_count++] = chunk;
+        }
+    }
+    pthread_mutex_unlock(&baker->mutex);
+    return baked;
+}
+
+bool glyph_baker_done(Glyph_Baker *baker)
+{
+    if (!baker->active) {
+        return true;
+    }
+
+    pthread_mutex_lock(&baker->mutex);
+    const bool done = baker->done;
+    pthread_mutex_unlock(&baker->mutex);
+    return done;
+}
+
+// Block until every glyph is baked
+void glyph_baker_wait(Glyph_Baker *baker)
+{
+    TRACE_FUNCTION();
+    for (size_t i = 0; i < baker->thread_count; ++i) {
+        pthread_join(baker->threads[i], NULL);
+    }
+    baker->thread_count = 0;
+}
+
+void glyph_baker_stop(Glyph_Baker *baker)
+{
+    if (!baker->active) {
+        return;
+    }
+
+    pthread_mutex_lock(&baker->mutex);
+    baker->cancel = true;
+    pthread_mutex_unlock(&baker->mutex);
+
+    for (size_t i = 0; i < baker->thread_count; ++i) {
+        pthread_join(baker->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&baker->mutex);
+    for (size_t i = 0; i < baker->count; ++i) {
+        free(baker->glyphs[i].coverage);
+    }
+    free(baker->glyphs);
+    free(baker->chunks);
+    free(baker->urgent);
+    free(baker->cache_path);
+    *baker = (Glyph_Baker) {0};
+}
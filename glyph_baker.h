@@ -0,0 +1,80 @@
+#ifndef GLYPH_BAKER_H_
+#define GLYPH_BAKER_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "./ttf.h"
+
+#define GLYPH_BAKER_MAX_THREADS 8
+#define GLYPH_BAKER_CHUNK 16
+// Bump whenever ttf.c rasterizes differently or glyph_baker_glyph_index
+// picks other glyphs, so caches written by older builds are baked again
+#define GLYPH_CACHE_VERSION 1
+
+// Coverage of one glyph, `w` by `h`, placed at (x0, y0) from the pen
+// position on the baseline, y down. Blank glyphs have no coverage.
+typedef struct {
+    uint32_t codepoint;
+    int x0;
+    int y0;
+    int w;
+    int h;
+    unsigned char *coverage;
+} Baked_Glyph;
+
+// Called from a worker thread once a chunk with a glyph asked for by
+// glyph_baker_want is baked
+typedef void (*Glyph_Baker_Ready)(void *data);
+
+// Rasterizes the glyphs of a range of codepoints at one size on worker
+// threads, chunk by chunk, skipping the ones the font does not have.
+// Chunks with glyphs that are wanted on screen go first. The finished set
+// is saved in the user's cache directory, keyed by a hash of the font
+// file and the size, and read back instead of rasterizing next time.
+// Glyphs are collected with glyph_baker_take as they come.
+typedef struct {
+    const Ttf_Font *ttf;
+    bool cp437_slots;
+    uint64_t font_hash;
+    int pixel_height;
+    float scale;
+    uint32_t first;
+    uint32_t last;
+    char *cache_path;
+    Glyph_Baker_Ready ready;
+    void *ready_data;
+    bool active;
+    size_t thread_count;
+    pthread_t threads[GLYPH_BAKER_MAX_THREADS];
+    pthread_mutex_t mutex;
+
+    // Guarded by mutex
+    uint32_t next;
+    // State of every chunk, and wanted chunks to bake before `next`
+    unsigned char *chunks;
+    size_t *urgent;
+    size_t urgent_count;
+    Baked_Glyph *glyphs;
+    size_t count;
+    size_t capacity;
+    size_t taken;
+    size_t running;
+    bool from_cache;
+    bool done;
+    bool cancel;
+} Glyph_Baker;
+
+uint64_t glyph_baker_hash(const unsigned char *data, size_t size);
+int glyph_baker_glyph_index(const Ttf_Font *ttf, bool cp437_slots, uint32_t codepoint);
+bool glyph_baker_rasterize(const Ttf_Font *ttf, uint32_t codepoint, int glyph, float scale, Baked_Glyph *baked);
+void glyph_baker_start(Glyph_Baker *baker, const Ttf_Font *ttf, bool cp437_slots, uint64_t font_hash, int pixel_height, float scale,
+                       uint32_t first, uint32_t last, Glyph_Baker_Ready ready, void *ready_data);
+Baked_Glyph *glyph_baker_take(Glyph_Baker *baker, size_t *count);
+bool glyph_baker_pending(Glyph_Baker *baker, int pixel_height, uint32_t codepoint);
+bool glyph_baker_want(Glyph_Baker *baker, uint32_t codepoint);
+bool glyph_baker_done(Glyph_Baker *baker);
+void glyph_baker_wait(Glyph_Baker *baker);
+void glyph_baker_stop(Glyph_Baker *baker);
+
+#endif // GLYPH_BAKER_H_
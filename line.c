@@ -0,0 +1,318 @@
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "./line.h"
+#include "./utf8.h"
+
+#define LINE_MIN_HEAP_CAPACITY 32
+
+static bool line_is_inline(const Line *line)
+{
+    return line->capacity <= LINE_INLINE_CAPACITY;
+}
+
+static char *line_data(Line *line)
+{
+    return line_is_inline(line) ? line->small : line->chars;
+}
+
+static const char *line_data_const(const Line *line)
+{
+    return line_is_inline(line) ? line->small : line->chars;
+}
+
+static size_t line_gap_size(const Line *line)
+{
+    return line->capacity - line->size;
+}
+
+// Smallest size class that holds `size` bytes
+static size_t line_size_class(size_t size)
+{
+    if (size <= LINE_INLINE_CAPACITY) {
+        return LINE_INLINE_CAPACITY;
+    }
+
+    size_t capacity = LINE_MIN_HEAP_CAPACITY;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+static char *line_alloc(Line *line, size_t capacity)
+{
+    char *chars = line->slab ? slab_alloc(line->slab, capacity) : malloc(capacity);
+    assert(chars != NULL);
+    return chars;
+}
+
+static void line_release(Line *line, char *chars, size_t capacity)
+{
+    if (line->slab) {
+        slab_free(line->slab, chars, capacity);
+    } else {
+        free(chars);
+    }
+}
+
+// Move the text into storage of `new_capacity` bytes, keeping the gap
+static void line_resize(Line *line, size_t new_capacity)
+{
+    assert(new_capacity >= line->size);
+    const size_t old_capacity = line->capacity;
+    const size_t tail_size = line->size - line->gap;
+
+    if (line_is_inline(line) && new_capacity <= LINE_INLINE_CAPACITY) {
+        memmove(line->small + new_capacity - tail_size,
+                line->small + old_capacity - tail_size,
+                tail_size);
+    } else {
+        char *old = line_is_inline(line) ? NULL : line->chars;
+        const char *src = old ? old : line->small;
+        char *dst = new_capacity <= LINE_INLINE_CAPACITY ? line->small : line_alloc(line, new_capacity);
+
+        memcpy(dst, src, line->gap);
+        memcpy(dst + new_capacity - tail_size,
+               src + old_capacity - tail_size,
+               tail_size);
+
+        if (dst != line->small) line->chars = dst;
+        if (old) line_release(line, old, old_capacity);
+    }
+
+    line->capacity = new_capacity;
+}
+
+static void line_grow(Line *line, size_t n)
+{
+    if (line->capacity - line->size < n) {
+        line_resize(line, line_size_class(line->size + n));
+    }
+}
+
+// Give memory back once three quarters of a heap line are unused
+static void line_shrink(Line *line)
+{
+    if (!line_is_inline(line) && line->size <= line->capacity / 4) {
+        line_resize(line, line_size_class(line->size * 2));
+    }
+}
+
+static void line_move_gap(Line *line, size_t col)
+{
+    assert(col <= line->size);
+    char *data = line_data(line);
+    const size_t gap_size = line_gap_size(line);
+
+    if (col < line->gap) {
+        memmove(data + col + gap_size,
+                data + col,
+                line->gap - col);
+    } else if (col > line->gap) {
+        memmove(data + line->gap,
+                data + line->gap + gap_size,
+                col - line->gap);
+    }
+    line->gap = col;
+}
+
+// Read-only Line over existing text. Short text is copied inline, longer
+// text is referenced in place and must outlive the view.
+Line line_view(const char *text, size_t text_size)
+{
+    Line line = {
+        .capacity = text_size,
+        .size = text_size,
+        .gap = text_size,
+    };
+
+    if (text_size <= LINE_INLINE_CAPACITY) {
+        line.capacity = LINE_INLINE_CAPACITY;
+        memcpy(line.small, text, text_size);
+    } else {
+        line.chars = (char *) text;
+    }
+    return line;
+}
+
+void line_insert_text_before(Line *line, const char* text, size_t *col)
+{
+    line_insert_text_sized_before(line, text, strlen(text), col);
+}
+
+void line_insert_text_sized_before(Line *line, const char *text, size_t text_size, size_t *col)
+{
+    if (*col > line->size) {
+        *col = line->size;
+    }
+
+    if (text_size == 0) {
+        return;
+    }
+
+    line_grow(line, text_size);
+    line_move_gap(line, *col);
+
+    memcpy(line_data(line) + line->gap, text, text_size);
+    line->gap += text_size;
+    line->size += text_size;
+    *col += text_size;
+}
+
+void line_backspace(Line *line, size_t *col)
+{
+    if (*col > line->size) {
+        *col = line->size;
+    }
+
+    if (*col > 0 && line->size > 0) {
+        const size_t n = *col - line_prev_col(line, *col);
+        line_move_gap(line, *col);
+        line->gap -= n;
+        line->size -= n;
+        *col -= n;
+        line_shrink(line);
+    }
+}
+
+void line_delete(Line *line, size_t *col)
+{
+    if (*col > line->size) {
+        *col = line->size;
+    }
+
+    if (*col < line->size && line->size > 0) {
+        const size_t n = line_next_col(line, *col) - *col;
+        line_move_gap(line, *col);
+        line->size -= n;
+        line_shrink(line);
+    }
+}
+
+void line_truncate(Line *line, size_t col)
+{
+    if (col < line->size) {
+        line_move_gap(line, col);
+        line->size = col;
+        line_shrink(line);
+    }
+}
+
+// Move everything from `col` onwards to the end of `tail`
+void line_split(Line *line, size_t col, Line *tail)
+{
+    if (col >= line->size) {
+        return;
+    }
+
+    line_move_gap(line, col);
+    size_t size = 0;
+    const char *text = line_text_after_gap(line, &size);
+    size_t tail_col = tail->size;
+    line_insert_text_sized_before(tail, text, size, &tail_col);
+    line_truncate(line, col);
+}
+
+// Append the text of `tail` to the end of `line`
+void line_join(Line *line, const Line *tail)
+{
+    size_t col = line->size;
+    size_t size = 0;
+    const char *text = line_text_before_gap(tail, &size);
+    line_insert_text_sized_before(line, text, size, &col);
+    text = line_text_after_gap(tail, &size);
+    line_insert_text_sized_before(line, text, size, &col);
+}
+
+void line_free(Line *line)
+{
+    if (!line_is_inline(line)) {
+        line_release(line, line->chars, line->capacity);
+    }
+    memset(line, 0, sizeof(*line));
+}
+
+// Heap bytes allocated beyond the text
+size_t line_slack(const Line *line)
+{
+    return line_is_inline(line) ? 0 : line->capacity - line->size;
+}
+
+const char *line_char_at(const Line *line, size_t col)
+{
+    assert(col < line->size);
+    if (col < line->gap) {
+        return &line_data_const(line)[col];
+    }
+    return &line_data_const(line)[col + line_gap_size(line)];
+}
+
+const char *line_text_before_gap(const Line *line, size_t *size)
+{
+    *size = line->gap;
+    return line_data_const(line);
+}
+
+const char *line_text_after_gap(const Line *line, size_t *size)
+{
+    *size = line->size - line->gap;
+    return line_data_const(line) + line->gap + line_gap_size(line);
+}
+
+// Where the character after the one at `col` starts. Characters are
+// split as by utf8_next, so `col` is expected to start one.
+size_t line_next_col(const Line *line, size_t col)
+{
+    if (col >= line->size) {
+        return line->size;
+    }
+    const size_t start = col;
+    if (UTF8_IS_CONTINUATION(*line_char_at(line, col))) {
+        return col + 1;
+    }
+    col += 1;
+    while (col < line->size && col - start < UTF8_MAX_SIZE && UTF8_IS_CONTINUATION(*line_char_at(line, col))) {
+        col += 1;
+    }
+    return col;
+}
+
+// Where the character before `col` starts: the byte before it, or the
+// first other byte within UTF8_MAX_SIZE of `col` if only continuation
+// bytes are between
+size_t line_prev_col(const Line *line, size_t col)
+{
+    if (col > line->size) {
+        col = line->size;
+    }
+    if (col == 0) {
+        return 0;
+    }
+    for (size_t lead = col - 1; col - lead <= UTF8_MAX_SIZE; --lead) {
+        if (!UTF8_IS_CONTINUATION(*line_char_at(line, lead))) {
+            return lead;
+        }
+        if (lead == 0) break;
+    }
+    return col - 1;
+}
+
+// Decode the character at `col` into `*codepoint`, returning its size
+size_t line_decode(const Line *line, size_t col, uint32_t *codepoint)
+{
+    assert(col < line->size);
+    const size_t next = line_next_col(line, col);
+    const size_t n = next - col;
+    if (col >= line->gap || next <= line->gap) {
+        *codepoint = utf8_decode(line_char_at(line, col), n);
+    } else {
+        // Split by the gap
+        char bytes[UTF8_MAX_SIZE];
+        for (size_t i = 0; i < n; ++i) {
+            bytes[i] = *line_char_at(line, col + i);
+        }
+        *codepoint = utf8_decode(bytes, n);
+    }
+    return n;
+}
@@ -0,0 +1,48 @@
+#ifndef LINE_H_
+#define LINE_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include "./slab.h"
+
+#define LINE_INLINE_CAPACITY 24
+
+// Gap buffer: the text is data[0..gap) followed by
+// data[gap + (capacity - size)..capacity). The gap follows the
+// last edit, so typing at the cursor never moves the tail.
+//
+// Short lines keep their text inline in the struct. Longer lines live
+// in power-of-two size classes and shrink back when most of their text
+// is deleted, so memory tracks the actual text size. Classes come from
+// `slab` when set, or from malloc otherwise.
+//
+// Columns (`col`) are byte offsets into UTF-8 text. Backspace and delete
+// remove a whole character.
+typedef struct {
+    Slab *slab;
+    size_t capacity;
+    size_t size;
+    size_t gap;
+    union {
+        char *chars;
+        char small[LINE_INLINE_CAPACITY];
+    };
+} Line;
+
+Line line_view(const char *text, size_t text_size);
+void line_insert_text_before(Line *line, const char* text, size_t *col);
+void line_insert_text_sized_before(Line *line, const char *text, size_t text_size, size_t *col);
+void line_backspace(Line *line, size_t *col);
+void line_delete(Line *line, size_t *col);
+void line_truncate(Line *line, size_t col);
+void line_split(Line *line, size_t col, Line *tail);
+void line_join(Line *line, const Line *tail);
+void line_free(Line *line);
+size_t line_slack(const Line *line);
+const char *line_char_at(const Line *line, size_t col);
+size_t line_next_col(const Line *line, size_t col);
+size_t line_prev_col(const Line *line, size_t col);
+size_t line_decode(const Line *line, size_t col, uint32_t *codepoint);
+const char *line_text_before_gap(const Line *line, size_t *size);
+const char *line_text_after_gap(const Line *line, size_t *size);
+
+#endif // LINE_H_
@@ -0,0 +1,235 @@
+#include <string.h>
+#include <assert.h>
+#include <stdbool.h>
+#include "./line_cache.h"
+
+#define LINE_CACHE_BYTES_PER_PIXEL 4
+
+struct Line_Cache_Entry {
+    Line_Key key;
+    SDL_Texture *texture;
+    int width;
+    int height;
+    // Next entry in the same bucket, or the next free entry
+    int next;
+    // Next entry of the same line
+    int line_next;
+    int lru_prev;
+    int lru_next;
+};
+
+static uint64_t line_key_hash(Line_Key key)
+{
+    uint32_t zoom = 0;
+    memcpy(&zoom, &key.zoom, sizeof(zoom));
+
+    uint64_t h = key.version * 0x9e3779b97f4a7c15ull;
+    h ^= (h >> 29) + key.first_col * 0xbf58476d1ce4e5b9ull;
+    h ^= (h >> 31) + key.cols * 0x94d049bb133111ebull;
+    h ^= (h >> 27) + ((uint64_t) zoom << 32 | key.color) * 0xff51afd7ed558ccdull;
+    return h ^ (h >> 33);
+}
+
+static bool line_key_equal(Line_Key a, Line_Key b)
+{
+    return a.version == b.version
+        && a.first_col == b.first_col
+        && a.cols == b.cols
+        && a.zoom == b.zoom
+        && a.color == b.color;
+}
+
+static int *line_cache_line_bucket(Line_Cache *cache, uint64_t line)
+{
+    const uint64_t h = line * 0x9e3779b97f4a7c15ull;
+    return &cache->line_buckets[(h ^ (h >> 32)) & (cache->bucket_count - 1)];
+}
+
+static size_t entry_bytes(const Line_Cache_Entry *entry)
+{
+    return (size_t) entry->width * entry->height * LINE_CACHE_BYTES_PER_PIXEL;
+}
+
+static int *line_cache_bucket(Line_Cache *cache, Line_Key key)
+{
+    return &cache->buckets[line_key_hash(key) & (cache->bucket_count - 1)];
+}
+
+static void lru_unlink(Line_Cache *cache, int i)
+{
+    Line_Cache_Entry *entry = &cache->entries[i];
+    if (entry->lru_prev >= 0) cache->entries[entry->lru_prev].lru_next = entry->lru_next;
+    else cache->lru_first = entry->lru_next;
+    if (entry->lru_next >= 0) cache->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    else cache->lru_last = entry->lru_prev;
+}
+
+static void lru_push_front(Line_Cache *cache, int i)
+{
+    Line_Cache_Entry *entry = &cache->entries[i];
+    entry->lru_prev = -1;
+    entry->lru_next = cache->lru_first;
+    if (cache->lru_first >= 0) cache->entries[cache->lru_first].lru_prev = i;
+    else cache->lru_last = i;
+    cache->lru_first = i;
+}
+
+// Take entry `i` out of the cache, handing its texture to the caller
+static SDL_Texture *line_cache_remove(Line_Cache *cache, int i)
+{
+    Line_Cache_Entry *entry = &cache->entries[i];
+
+    int *link = line_cache_bucket(cache, entry->key);
+    while (*link != i) {
+        assert(*link >= 0);
+        link = &cache->entries[*link].next;
+    }
+    *link = entry->next;
+    link = line_cache_line_bucket(cache, entry->key.line);
+    while (*link != i) {
+        assert(*link >= 0);
+        link = &cache->entries[*link].line_next;
+    }
+    *link = entry->line_next;
+    lru_unlink(cache, i);
+
+    SDL_Texture *texture = entry->texture;
+    cache->stats.bytes -= entry_bytes(entry);
+    cache->stats.entries -= 1;
+
+    *entry = (Line_Cache_Entry) {
+        .next = cache->free_entries,
+    };
+    cache->free_entries = i;
+    return texture;
+}
+
+static void line_cache_evict(Line_Cache *cache, int i)
+{
+    SDL_DestroyTexture(line_cache_remove(cache, i));
+    cache->stats.evictions += 1;
+}
+
+void line_cache_init(Line_Cache *cache, size_t max_entries, size_t max_bytes)
+{
+    assert(max_entries > 0);
+
+    *cache = (Line_Cache) {
+        .max_entries = max_entries,
+        .max_bytes = max_bytes,
+        .bucket_count = 1,
+        .lru_first = -1,
+        .lru_last = -1,
+    };
+    while (cache->bucket_count < max_entries * 2) {
+        cache->bucket_count *= 2;
+    }
+
+    cache->entries = malloc(max_entries * sizeof(cache->entries[0]));
+    cache->buckets = malloc(cache->bucket_count * sizeof(cache->buckets[0]));
+    cache->line_buckets = malloc(cache->bucket_count * sizeof(cache->line_buckets[0]));
+    assert(cache->entries != NULL && cache->buckets != NULL && cache->line_buckets != NULL);
+    for (size_t i = 0; i < cache->bucket_count; ++i) {
+        cache->buckets[i] = -1;
+        cache->line_buckets[i] = -1;
+    }
+    for (size_t i = 0; i < max_entries; ++i) {
+        cache->entries[i] = (Line_Cache_Entry) {
+            .next = i + 1 < max_entries ? (int) i + 1 : -1,
+        };
+    }
+    cache->free_entries = 0;
+}
+
+// Texture for `key` and its width in pixels, or NULL if it is not cached
+SDL_Texture *line_cache_get(Line_Cache *cache, Line_Key key, int *width)
+{
+    for (int i = *line_cache_bucket(cache, key); i >= 0; i = cache->entries[i].next) {
+        Line_Cache_Entry *entry = &cache->entries[i];
+        if (line_key_equal(entry->key, key)) {
+            cache->stats.hits += 1;
+            lru_unlink(cache, i);
+            lru_push_front(cache, i);
+            *width = entry->width;
+            return entry->texture;
+        }
+    }
+
+    cache->stats.misses += 1;
+    return NULL;
+}
+
+// Drop the entries of `key.line` drawn from other versions of its text,
+// as an edited row never goes back to an old version. Returns the
+// texture of one that is `width` by `height`, for the caller to draw
+// over instead of creating a new one, or NULL.
+SDL_Texture *line_cache_take_stale(Line_Cache *cache, Line_Key key, int width, int height)
+{
+    SDL_Texture *reused = NULL;
+    int i = *line_cache_line_bucket(cache, key.line);
+    while (i >= 0) {
+        const Line_Cache_Entry *entry = &cache->entries[i];
+        const int next = entry->line_next;
+        if (entry->key.line == key.line && entry->key.version != key.version) {
+            const bool fits = reused == NULL && entry->width == width && entry->height == height;
+            SDL_Texture *texture = line_cache_remove(cache, i);
+            if (fits) {
+                reused = texture;
+            } else {
+                SDL_DestroyTexture(texture);
+            }
+            cache->stats.replaced += 1;
+        }
+        i = next;
+    }
+    return reused;
+}
+
+// Cache `texture` under `key`; the cache owns it from now on
+void line_cache_put(Line_Cache *cache, Line_Key key, SDL_Texture *texture, int width, int height)
+{
+    const size_t bytes = (size_t) width * height * LINE_CACHE_BYTES_PER_PIXEL;
+    while (cache->lru_last >= 0 &&
+           (cache->stats.entries >= cache->max_entries || cache->stats.bytes + bytes > cache->max_bytes)) {
+        line_cache_evict(cache, cache->lru_last);
+    }
+
+    const int i = cache->free_entries;
+    assert(i >= 0);
+    Line_Cache_Entry *entry = &cache->entries[i];
+    cache->free_entries = entry->next;
+
+    int *bucket = line_cache_bucket(cache, key);
+    int *line_bucket = line_cache_line_bucket(cache, key.line);
+    *entry = (Line_Cache_Entry) {
+        .key = key,
+        .texture = texture,
+        .width = width,
+        .height = height,
+        .next = *bucket,
+        .line_next = *line_bucket,
+    };
+    *bucket = i;
+    *line_bucket = i;
+    lru_push_front(cache, i);
+
+    cache->stats.entries += 1;
+    cache->stats.bytes += bytes;
+}
+
+// Drop every texture, e.g. after the renderer lost them
+void line_cache_clear(Line_Cache *cache)
+{
+    while (cache->lru_last >= 0) {
+        line_cache_evict(cache, cache->lru_last);
+    }
+}
+
+void line_cache_free(Line_Cache *cache)
+{
+    line_cache_clear(cache);
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache->line_buckets);
+    *cache = (Line_Cache) {0};
+}
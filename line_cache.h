@@ -0,0 +1,55 @@
+#ifndef LINE_CACHE_H_
+#define LINE_CACHE_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <SDL2/SDL.h>
+
+// What a cached texture shows: columns [first_col, first_col + cols) of
+// the row whose text has `version`, drawn at `zoom` in `color`. `line`
+// names the row itself and stays the same while its text is edited.
+typedef struct {
+    uint64_t line;
+    uint64_t version;
+    size_t first_col;
+    size_t cols;
+    float zoom;
+    Uint32 color;
+} Line_Key;
+
+typedef struct {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t replaced;
+    size_t entries;
+    size_t bytes;
+} Line_Cache_Stats;
+
+typedef struct Line_Cache_Entry Line_Cache_Entry;
+
+// Least recently used cache of rendered line textures. Entries are
+// evicted once there are more than `max_entries` of them or their
+// textures take more than `max_bytes` of video memory.
+// Entries are also chained by line, so the textures of text a row no
+// longer has can be dropped or reused as soon as it is drawn again.
+typedef struct {
+    Line_Cache_Entry *entries;
+    int *buckets;
+    int *line_buckets;
+    size_t bucket_count;
+    size_t max_entries;
+    size_t max_bytes;
+    int free_entries;
+    int lru_first;
+    int lru_last;
+    Line_Cache_Stats stats;
+} Line_Cache;
+
+void line_cache_init(Line_Cache *cache, size_t max_entries, size_t max_bytes);
+SDL_Texture *line_cache_get(Line_Cache *cache, Line_Key key, int *width);
+SDL_Texture *line_cache_take_stale(Line_Cache *cache, Line_Key key, int width, int height);
+void line_cache_put(Line_Cache *cache, Line_Key key, SDL_Texture *texture, int width, int height);
+void line_cache_clear(Line_Cache *cache);
+void line_cache_free(Line_Cache *cache);
+
+#endif // LINE_CACHE_H_
@@ -0,0 +1,258 @@
+#include <assert.h>
+#include "./line_index.h"
+
+#define LINE_INDEX_BLOCK_NODES 4096
+
+struct Line_Index_Node {
+    Piece piece;
+    size_t bytes;
+    size_t subtree_rows;
+    size_t subtree_bytes;
+    uint32_t priority;
+    Line_Index_Node *left;
+    Line_Index_Node *right;
+};
+
+struct Line_Index_Block {
+    Line_Index_Block *next;
+    Line_Index_Node nodes[LINE_INDEX_BLOCK_NODES];
+};
+
+static Line_Index_Node *line_index_alloc_node(Line_Index *index)
+{
+    if (index->free_nodes == NULL) {
+        Line_Index_Block *block = malloc(sizeof(*block));
+        assert(block != NULL);
+        block->next = index->blocks;
+        index->blocks = block;
+        for (size_t i = 0; i < LINE_INDEX_BLOCK_NODES; ++i) {
+            block->nodes[i].left = index->free_nodes;
+            index->free_nodes = &block->nodes[i];
+        }
+    }
+
+    Line_Index_Node *node = index->free_nodes;
+    index->free_nodes = node->left;
+    return node;
+}
+
+static void line_index_free_node(Line_Index *index, Line_Index_Node *node)
+{
+    node->left = index->free_nodes;
+    index->free_nodes = node;
+}
+
+static size_t node_rows(const Line_Index_Node *node)
+{
+    return node ? node->subtree_rows : 0;
+}
+
+static size_t node_bytes(const Line_Index_Node *node)
+{
+    return node ? node->subtree_bytes : 0;
+}
+
+static void node_update(Line_Index_Node *node)
+{
+    node->subtree_rows = node_rows(node->left) + node->piece.count + node_rows(node->right);
+    node->subtree_bytes = node_bytes(node->left) + node->bytes + node_bytes(node->right);
+}
+
+// Split into the pieces before `row` and the pieces from `row` onwards.
+// `row` must fall on a piece boundary.
+static void node_split(Line_Index_Node *node, size_t row, Line_Index_Node **left, Line_Index_Node **right)
+{
+    if (node == NULL) {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+
+    const size_t left_rows = node_rows(node->left);
+    if (row <= left_rows) {
+        node_split(node->left, row, left, &node->left);
+        *right = node;
+    } else {
+        assert(row >= left_rows + node->piece.count);
+        node_split(node->right, row - left_rows - node->piece.count, &node->right, right);
+        *left = node;
+    }
+    node_update(node);
+}
+
+static Line_Index_Node *node_merge(Line_Index_Node *left, Line_Index_Node *right)
+{
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+
+    if (left->priority > right->priority) {
+        left->right = node_merge(left->right, right);
+        node_update(left);
+        return left;
+    } else {
+        right->left = node_merge(left, right->left);
+        node_update(right);
+        return right;
+    }
+}
+
+static Line_Index_Node *node_remove(Line_Index *index, Line_Index_Node *node, size_t row)
+{
+    assert(node != NULL);
+
+    const size_t left_rows = node_rows(node->left);
+    if (row < left_rows) {
+        node->left = node_remove(index, node->left, row);
+    } else if (row == left_rows) {
+        Line_Index_Node *rest = node_merge(node->left, node->right);
+        line_index_free_node(index, node);
+        return rest;
+    } else {
+        assert(row >= left_rows + node->piece.count);
+        node->right = node_remove(index, node->right, row - left_rows - node->piece.count);
+    }
+    node_update(node);
+    return node;
+}
+
+static void node_set_bytes(Line_Index_Node *node, size_t row, size_t bytes)
+{
+    assert(node != NULL);
+
+    const size_t left_rows = node_rows(node->left);
+    if (row < left_rows) {
+        node_set_bytes(node->left, row, bytes);
+    } else if (row < left_rows + node->piece.count) {
+        node->bytes = bytes;
+    } else {
+        node_set_bytes(node->right, row - left_rows - node->piece.count, bytes);
+    }
+    node_update(node);
+}
+
+static void node_visit(const Line_Index_Node *node, Line_Index_Visit visit, void *data)
+{
+    while (node != NULL) {
+        node_visit(node->left, visit, data);
+        visit(node->piece, node->bytes, data);
+        node = node->right;
+    }
+}
+
+static uint32_t line_index_next_priority(Line_Index *index)
+{
+    // xorshift32
+    uint32_t x = index->seed ? index->seed : 0x9e3779b9;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    index->seed = x;
+    return x;
+}
+
+size_t line_index_rows(const Line_Index *index)
+{
+    return node_rows(index->root);
+}
+
+size_t line_index_bytes(const Line_Index *index)
+{
+    return node_bytes(index->root);
+}
+
+// Piece holding `row`; `offset` is the row within that piece and
+// `piece_byte` (optional) is the byte at which the piece starts.
+Piece line_index_find(const Line_Index *index, size_t row, size_t *offset, size_t *piece_byte)
+{
+    assert(row < line_index_rows(index));
+
+    const Line_Index_Node *node = index->root;
+    size_t bytes_before = 0;
+    for (;;) {
+        const size_t left_rows = node_rows(node->left);
+        if (row < left_rows) {
+            node = node->left;
+        } else if (row < left_rows + node->piece.count) {
+            *offset = row - left_rows;
+            if (piece_byte) *piece_byte = bytes_before + node_bytes(node->left);
+            return node->piece;
+        } else {
+            row -= left_rows + node->piece.count;
+            bytes_before += node_bytes(node->left) + node->bytes;
+            node = node->right;
+        }
+    }
+}
+
+// Piece holding byte offset `byte`, with the row and byte it starts at
+Piece line_index_find_byte(const Line_Index *index, size_t byte, size_t *piece_row, size_t *piece_byte)
+{
+    assert(byte < line_index_bytes(index));
+
+    const Line_Index_Node *node = index->root;
+    size_t rows_before = 0;
+    size_t bytes_before = 0;
+    for (;;) {
+        const size_t left_bytes = node_bytes(node->left);
+        if (byte < left_bytes) {
+            node = node->left;
+        } else if (byte < left_bytes + node->bytes) {
+            *piece_row = rows_before + node_rows(node->left);
+            *piece_byte = bytes_before + left_bytes;
+            return node->piece;
+        } else {
+            byte -= left_bytes + node->bytes;
+            rows_before += node_rows(node->left) + node->piece.count;
+            bytes_before += left_bytes + node->bytes;
+            node = node->right;
+        }
+    }
+}
+
+// Insert `piece` so that it starts at `row`, which must be a piece boundary
+void line_index_insert(Line_Index *index, size_t row, Piece piece, size_t bytes)
+{
+    assert(row <= line_index_rows(index));
+
+    Line_Index_Node *node = line_index_alloc_node(index);
+    *node = (Line_Index_Node) {
+        .piece = piece,
+        .bytes = bytes,
+        .priority = line_index_next_priority(index),
+    };
+    node_update(node);
+
+    Line_Index_Node *left = NULL;
+    Line_Index_Node *right = NULL;
+    node_split(index->root, row, &left, &right);
+    index->root = node_merge(node_merge(left, node), right);
+}
+
+// Remove the piece that starts at `row`
+void line_index_remove(Line_Index *index, size_t row)
+{
+    index->root = node_remove(index, index->root, row);
+}
+
+// Update the byte size of the piece holding `row`
+void line_index_set_bytes(Line_Index *index, size_t row, size_t bytes)
+{
+    node_set_bytes(index->root, row, bytes);
+}
+
+// Call `visit` on every piece in row order
+void line_index_visit(const Line_Index *index, Line_Index_Visit visit, void *data)
+{
+    node_visit(index->root, visit, data);
+}
+
+void line_index_free(Line_Index *index)
+{
+    while (index->blocks) {
+        Line_Index_Block *next = index->blocks->next;
+        free(index->blocks);
+        index->blocks = next;
+    }
+    index->root = NULL;
+    index->free_nodes = NULL;
+}
@@ -0,0 +1,45 @@
+#ifndef LINE_INDEX_H_
+#define LINE_INDEX_H_
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef enum {
+    PIECE_ORIGINAL = 0,
+    PIECE_ADDED,
+} Piece_Source;
+
+// A run of consecutive rows taken from one of the two buffers
+typedef struct {
+    Piece_Source source;
+    size_t start;
+    size_t count;
+} Piece;
+
+typedef struct Line_Index_Node Line_Index_Node;
+typedef struct Line_Index_Block Line_Index_Block;
+
+// Balanced tree (treap) of pieces ordered by row. Every node caches the
+// number of rows and bytes in its subtree, so looking up, inserting and
+// removing the piece at a row, or the piece holding a byte offset, is
+// O(log pieces) however large the document is. Nodes are pooled in
+// blocks, so freeing the index does not free pieces one by one.
+typedef struct {
+    Line_Index_Node *root;
+    Line_Index_Node *free_nodes;
+    Line_Index_Block *blocks;
+    uint32_t seed;
+} Line_Index;
+
+typedef void (*Line_Index_Visit)(Piece piece, size_t bytes, void *data);
+
+size_t line_index_rows(const Line_Index *index);
+size_t line_index_bytes(const Line_Index *index);
+Piece line_index_find(const Line_Index *index, size_t row, size_t *offset, size_t *piece_byte);
+Piece line_index_find_byte(const Line_Index *index, size_t byte, size_t *piece_row, size_t *piece_byte);
+void line_index_insert(Line_Index *index, size_t row, Piece piece, size_t bytes);
+void line_index_remove(Line_Index *index, size_t row);
+void line_index_set_bytes(Line_Index *index, size_t row, size_t bytes);
+void line_index_visit(const Line_Index *index, Line_Index_Visit visit, void *data);
+void line_index_free(Line_Index *index);
+
+#endif // LINE_INDEX_H_
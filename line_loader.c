@@ -0,0 +1,210 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <assert.h>
+#include "./line_loader.h"
+#include "./newline_index.h"
+#include "./utf8.h"
+#include "./trace.h"
+
+// Hand over the starts found in text[..scanned). Takes ownership of `starts`.
+static void line_loader_publish(Line_Loader *loader, size_t *starts, size_t count, size_t scanned)
+{
+    pthread_mutex_lock(&loader->mutex);
+
+    if (loader->ready == NULL) {
+        loader->ready = starts;
+        loader->ready_count = count;
+        loader->ready_capacity = count;
+        starts = NULL;
+    } else {
+        if (loader->ready_capacity - loader->ready_count < count + 1) {
+            loader->ready_capacity = (loader->ready_count + count + 1) * 2;
+            loader->ready = realloc(loader->ready, loader->ready_capacity * sizeof(loader->ready[0]));
+            assert(loader->ready != NULL);
+        }
+        memcpy(loader->ready + loader->ready_count, starts, count * sizeof(starts[0]));
+        loader->ready_count += count;
+    }
+
+    loader->scanned = scanned;
+    if (scanned == loader->text_size) {
+        // The last line has no '\n' to end it
+        if (loader->text_size > 0 && loader->text[loader->text_size - 1] != '\n') {
+            if (loader->ready_capacity - loader->ready_count < 1) {
+                loader->ready_capacity = loader->ready_count + 1;
+                loader->ready = realloc(loader->ready, loader->ready_capacity * sizeof(loader->ready[0]));
+                assert(loader->ready != NULL);
+            }
+            loader->ready[loader->ready_count++] = loader->text_size;
+        }
+        loader->done = true;
+    }
+
+    pthread_mutex_unlock(&loader->mutex);
+    free(starts);
+}
+
+// Validate the text up to `end`. A character cut by `end` is left for
+// the next call, which carries on from its first byte.
+static void line_loader_validate(Line_Loader *loader, size_t end)
+{
+    TRACE_FUNCTION();
+    if (end < loader->text_size) {
+        size_t lead = end;
+        while (lead > loader->validated && end - lead < UTF8_MAX_CONTINUATIONS && UTF8_IS_CONTINUATION(loader->text[lead])) {
+            lead -= 1;
+        }
+        // Past that many continuation bytes, the one at `end` starts a
+        // character of its own
+        if (!UTF8_IS_CONTINUATION(loader->text[lead])) {
+            end = lead;
+        }
+    }
+
+    size_t first_error = 0;
+    const size_t errors = utf8_validate(loader->text + loader->validated, end - loader->validated, &first_error);
+    if (errors > 0) {
+        pthread_mutex_lock(&loader->mutex);
+        if (loader->utf8_errors == 0) {
+            loader->first_utf8_error = loader->validated + first_error;
+        }
+        loader->utf8_errors += errors;
+        pthread_mutex_unlock(&loader->mutex);
+    }
+    loader->validated = end;
+}
+
+static void *line_loader_run(void *arg)
+{
+    Line_Loader *loader = arg;
+    TRACE_THREAD_NAME("line loader");
+
+    pthread_mutex_lock(&loader->mutex);
+    size_t begin = loader->scanned;
+    pthread_mutex_unlock(&loader->mutex);
+
+    while (begin < loader->text_size) {
+        pthread_mutex_lock(&loader->mutex);
+        const bool cancel = loader->cancel;
+        pthread_mutex_unlock(&loader->mutex);
+        if (cancel) {
+            break;
+        }
+
+        TRACE_ZONE("line_loader_block");
+        size_t end = begin + LINE_LOADER_BLOCK_SIZE;
+        if (end > loader->text_size) end = loader->text_size;
+
+        line_loader_validate(loader, end);
+        size_t count = 0;
+        size_t *starts = newline_index_range(loader->text, begin, end, &count);
+        line_loader_publish(loader, starts, count, end);
+        begin = end;
+    }
+
+    return NULL;
+}
+
+void line_loader_start(Line_Loader *loader, const char *text, size_t text_size)
+{
+    *loader = (Line_Loader) {
+        .text = text,
+        .text_size = text_size,
+        .active = true,
+    };
+    pthread_mutex_init(&loader->mutex, NULL);
+
+    const size_t head = text_size < LINE_LOADER_HEAD_SIZE ? text_size : LINE_LOADER_HEAD_SIZE;
+    line_loader_validate(loader, head);
+    size_t count = 0;
+    size_t *starts = newline_index_range(text, 0, head, &count);
+    line_loader_publish(loader, starts, count, head);
+
+    if (head < text_size) {
+        loader->running = pthread_create(&loader->thread, NULL, line_loader_run, loader) == 0;
+        if (!loader->running) {
+            line_loader_run(loader);
+        }
+    }
+}
+
+// Line starts found since the last call, in order, or NULL if there are
+// none. Each is where the line after a newly indexed one begins. The
+// caller owns the returned array. `scanned` is how far the text has been
+// read, at or after the last returned start.
+size_t *line_loader_take(Line_Loader *loader, size_t *count, size_t *scanned)
+{
+    *count = 0;
+    *scanned = 0;
+    if (!loader->active) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    size_t *ready = loader->ready;
+    *count = loader->ready_count;
+    *scanned = loader->scanned;
+    loader->ready = NULL;
+    loader->ready_count = 0;
+    loader->ready_capacity = 0;
+    pthread_mutex_unlock(&loader->mutex);
+
+    return ready;
+}
+
+float line_loader_progress(Line_Loader *loader)
+{
+    if (!loader->active || loader->text_size == 0) {
+        return 1.0f;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    const float progress = (float) loader->scanned / (float) loader->text_size;
+    pthread_mutex_unlock(&loader->mutex);
+    return progress;
+}
+
+bool line_loader_done(Line_Loader *loader)
+{
+    if (!loader->active) {
+        return true;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    const bool done = loader->done;
+    pthread_mutex_unlock(&loader->mutex);
+    return done;
+}
+
+// Number of characters that are not UTF-8 in the text scanned so far,
+// and where the first one is
+size_t line_loader_utf8_errors(Line_Loader *loader, size_t *first_error)
+{
+    if (!loader->active) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    const size_t errors = loader->utf8_errors;
+    *first_error = loader->first_utf8_error;
+    pthread_mutex_unlock(&loader->mutex);
+    return errors;
+}
+
+void line_loader_stop(Line_Loader *loader)
+{
+    if (!loader->active) {
+        return;
+    }
+
+    pthread_mutex_lock(&loader->mutex);
+    loader->cancel = true;
+    pthread_mutex_unlock(&loader->mutex);
+
+    if (loader->running) {
+        pthread_join(loader->thread, NULL);
+    }
+    pthread_mutex_destroy(&loader->mutex);
+    free(loader->ready);
+    *loader = (Line_Loader) {0};
+}
@@ -0,0 +1,43 @@
+#ifndef LINE_LOADER_H_
+#define LINE_LOADER_H_
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define LINE_LOADER_HEAD_SIZE (1024 * 1024)
+#define LINE_LOADER_BLOCK_SIZE (64 * 1024 * 1024)
+
+// Finds the line starts of a text in the background. line_loader_start
+// indexes the head of the text right away so the first screen can be
+// shown immediately, then a worker thread scans the rest block by block.
+// Finished line starts are collected with line_loader_take. The text is
+// checked to be UTF-8 along the way.
+typedef struct {
+    const char *text;
+    size_t text_size;
+    bool active;
+    bool running;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    // Checked for UTF-8 up to here, by whoever is scanning
+    size_t validated;
+
+    // Guarded by mutex
+    size_t *ready;
+    size_t ready_count;
+    size_t ready_capacity;
+    size_t scanned;
+    size_t utf8_errors;
+    size_t first_utf8_error;
+    bool done;
+    bool cancel;
+} Line_Loader;
+
+void line_loader_start(Line_Loader *loader, const char *text, size_t text_size);
+size_t *line_loader_take(Line_Loader *loader, size_t *count, size_t *scanned);
+float line_loader_progress(Line_Loader *loader);
+bool line_loader_done(Line_Loader *loader);
+size_t line_loader_utf8_errors(Line_Loader *loader, size_t *first_error);
+void line_loader_stop(Line_Loader *loader);
+
+#endif // LINE_LOADER_H_
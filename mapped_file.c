@@ -0,0 +1,51 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "./mapped_file.h"
+
+bool mapped_file_open(Mapped_File *file, const char *file_path)
+{
+    *file = (Mapped_File) {0};
+
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, "ERROR: could not stat file %s: %s\n", file_path, strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    // mmap refuses empty mappings; an empty file is just no text
+    if (st.st_size > 0) {
+        void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            fprintf(stderr, "ERROR: could not map file %s: %s\n", file_path, strerror(errno));
+            close(fd);
+            return false;
+        }
+        file->data = data;
+        file->size = st.st_size;
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    return true;
+}
+
+void mapped_file_close(Mapped_File *file)
+{
+    if (file->data) {
+        munmap((void *) file->data, file->size);
+    }
+    *file = (Mapped_File) {0};
+}
@@ -0,0 +1,15 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+#include <stdlib.h>
+#include <stdbool.h>
+
+// Read-only memory mapping of a whole file
+typedef struct {
+    const char *data;
+    size_t size;
+} Mapped_File;
+
+bool mapped_file_open(Mapped_File *file, const char *file_path);
+void mapped_file_close(Mapped_File *file);
+
+#endif // MAPPED_FILE_H_
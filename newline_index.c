@@ -0,0 +1,314 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "./newline_index.h"
+#include "./trace.h"
+
+#define NEWLINE_INDEX_PARALLEL_MIN_SIZE (64 * 1024 * 1024)
+#define NEWLINE_INDEX_MAX_THREADS 64
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NEWLINE_INDEX_X86
+#include <immintrin.h>
+#endif
+
+typedef struct {
+    size_t *items;
+    size_t count;
+    size_t capacity;
+} Offsets;
+
+typedef void (*Scan_Func)(const char *text, size_t begin, size_t end, Offsets *offsets);
+
+static void offsets_reserve(Offsets *offsets, size_t n)
+{
+    if (offsets->capacity - offsets->count < n) {
+        size_t new_capacity = offsets->capacity == 0 ? 1024 : offsets->capacity;
+        while (new_capacity - offsets->count < n) {
+            new_capacity *= 2;
+        }
+        offsets->items = realloc(offsets->items, new_capacity * sizeof(offsets->items[0]));
+        assert(offsets->items != NULL);
+        offsets->capacity = new_capacity;
+    }
+}
+
+static void offsets_push(Offsets *offsets, size_t offset)
+{
+    offsets_reserve(offsets, 1);
+    offsets->items[offsets->count++] = offset;
+}
+
+// Append the start of the line after every '\n' in text[begin..end)
+static void scan_scalar(const char *text, size_t begin, size_t end, Offsets *offsets)
+{
+    for (size_t i = begin; i < end; ++i) {
+        if (text[i] == '\n') {
+            offsets_push(offsets, i + 1);
+        }
+    }
+}
+
+#ifdef NEWLINE_INDEX_X86
+static void offsets_push_mask(Offsets *offsets, size_t base, uint64_t mask)
+{
+    offsets_reserve(offsets, 64);
+    while (mask) {
+        offsets->items[offsets->count++] = base + __builtin_ctzll(mask) + 1;
+        mask &= mask - 1;
+    }
+}
+
+__attribute__((target("sse2")))
+static void scan_sse2(const char *text, size_t begin, size_t end, Offsets *offsets)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t i = begin;
+    for (; i + 64 <= end; i += 64) {
+        const __m128i a = _mm_loadu_si128((const __m128i *) (text + i));
+        const __m128i b = _mm_loadu_si128((const __m128i *) (text + i + 16));
+        const __m128i c = _mm_loadu_si128((const __m128i *) (text + i + 32));
+        const __m128i d = _mm_loadu_si128((const __m128i *) (text + i + 48));
+        const uint64_t mask =
+            (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(a, newline)) |
+            (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(b, newline)) << 16 |
+            (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(c, newline)) << 32 |
+            (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(d, newline)) << 48;
+        if (mask) {
+            offsets_push_mask(offsets, i, mask);
+        }
+    }
+    scan_scalar(text, i, end, offsets);
+}
+
+__attribute__((target("avx2")))
+static void scan_avx2(const char *text, size_t begin, size_t end, Offsets *offsets)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t i = begin;
+    for (; i + 64 <= end; i += 64) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *) (text + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *) (text + i + 32));
+        const uint64_t mask =
+            (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, newline)) |
+            (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, newline)) << 32;
+        if (mask) {
+            offsets_push_mask(offsets, i, mask);
+        }
+    }
+    scan_scalar(text, i, end, offsets);
+}
+#endif // NEWLINE_INDEX_X86
+
+bool newline_scanner_supported(Newline_Scanner scanner)
+{
+    switch (scanner) {
+    case NEWLINE_SCANNER_AUTO:
+    case NEWLINE_SCANNER_SCALAR:
+        return true;
+#ifdef NEWLINE_INDEX_X86
+    case NEWLINE_SCANNER_SSE2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2");
+    case NEWLINE_SCANNER_AVX2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+const char *newline_scanner_name(Newline_Scanner scanner)
+{
+    switch (scanner) {
+    case NEWLINE_SCANNER_AUTO:   return "auto";
+    case NEWLINE_SCANNER_SCALAR: return "scalar";
+    case NEWLINE_SCANNER_SSE2:   return "sse2";
+    case NEWLINE_SCANNER_AVX2:   return "avx2";
+    default:                     return "unknown";
+    }
+}
+
+static Newline_Scanner newline_scanner_best(void)
+{
+    static Newline_Scanner best = NEWLINE_SCANNER_AUTO;
+    if (best == NEWLINE_SCANNER_AUTO) {
+        if (newline_scanner_supported(NEWLINE_SCANNER_AVX2)) {
+            best = NEWLINE_SCANNER_AVX2;
+        } else if (newline_scanner_supported(NEWLINE_SCANNER_SSE2)) {
+            best = NEWLINE_SCANNER_SSE2;
+        } else {
+            best = NEWLINE_SCANNER_SCALAR;
+        }
+    }
+    return best;
+}
+
+static Scan_Func newline_scanner_func(Newline_Scanner scanner)
+{
+    if (scanner == NEWLINE_SCANNER_AUTO) {
+        scanner = newline_scanner_best();
+    }
+
+    assert(newline_scanner_supported(scanner));
+    switch (scanner) {
+#ifdef NEWLINE_INDEX_X86
+    case NEWLINE_SCANNER_SSE2: return scan_sse2;
+    case NEWLINE_SCANNER_AVX2: return scan_avx2;
+#endif
+    default:                   return scan_scalar;
+    }
+}
+
+size_t newline_index_default_threads(void)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    if (cpus > NEWLINE_INDEX_MAX_THREADS) return NEWLINE_INDEX_MAX_THREADS;
+    return cpus;
+}
+
+typedef struct {
+    Scan_Func scan;
+    const char *text;
+    size_t begin;
+    size_t end;
+    Offsets offsets;
+    size_t *dst;
+} Index_Chunk;
+
+static void *index_chunk_scan(void *arg)
+{
+    Index_Chunk *chunk = arg;
+    // Guess ~64 bytes per line to skip most of the early regrowth
+    offsets_reserve(&chunk->offsets, (chunk->end - chunk->begin) / 64 + 1);
+    chunk->scan(chunk->text, chunk->begin, chunk->end, &chunk->offsets);
+    return NULL;
+}
+
+static void *index_chunk_copy(void *arg)
+{
+    Index_Chunk *chunk = arg;
+    if (chunk->offsets.count > 0) {
+        memcpy(chunk->dst, chunk->offsets.items, chunk->offsets.count * sizeof(chunk->offsets.items[0]));
+    }
+    free(chunk->offsets.items);
+    chunk->offsets = (Offsets) {0};
+    return NULL;
+}
+
+// Run `job` on every chunk, one thread per chunk with the first one on
+// the calling thread. Chunks whose thread cannot be started run here too.
+static void index_chunks_run(Index_Chunk *chunks, size_t n, void *(*job)(void *))
+{
+    pthread_t threads[NEWLINE_INDEX_MAX_THREADS];
+    bool started[NEWLINE_INDEX_MAX_THREADS] = {0};
+
+    for (size_t i = 1; i < n; ++i) {
+        started[i] = pthread_create(&threads[i], NULL, job, &chunks[i]) == 0;
+    }
+    job(&chunks[0]);
+    for (size_t i = 1; i < n; ++i) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            job(&chunks[i]);
+        }
+    }
+}
+
+// Append the start of the line after every '\n' in text[begin..end),
+// scanning `threads` slices concurrently and stitching their tables.
+static void index_range(Scan_Func scan, const char *text, size_t begin, size_t end, size_t threads, Offsets *offsets)
+{
+    if (threads < 1) threads = 1;
+    if (threads > NEWLINE_INDEX_MAX_THREADS) threads = NEWLINE_INDEX_MAX_THREADS;
+
+    if (threads == 1) {
+        offsets_reserve(offsets, (end - begin) / 64 + 1);
+        scan(text, begin, end, offsets);
+        return;
+    }
+
+    Index_Chunk chunks[NEWLINE_INDEX_MAX_THREADS] = {0};
+    const size_t slice = (end - begin) / threads;
+    for (size_t i = 0; i < threads; ++i) {
+        chunks[i].scan = scan;
+        chunks[i].text = text;
+        chunks[i].begin = begin + i * slice;
+        chunks[i].end = i + 1 == threads ? end : begin + (i + 1) * slice;
+    }
+    index_chunks_run(chunks, threads, index_chunk_scan);
+
+    size_t total = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        total += chunks[i].offsets.count;
+    }
+
+    offsets_reserve(offsets, total + 1);
+    for (size_t i = 0; i < threads; ++i) {
+        chunks[i].dst = offsets->items + offsets->count;
+        offsets->count += chunks[i].offsets.count;
+    }
+    index_chunks_run(chunks, threads, index_chunk_copy);
+}
+
+size_t *newline_index(const char *text, size_t text_size, size_t *count)
+{
+    TRACE_FUNCTION();
+    if (text_size >= NEWLINE_INDEX_PARALLEL_MIN_SIZE) {
+        const size_t threads = newline_index_default_threads();
+        if (threads > 1) {
+            return newline_index_parallel(NEWLINE_SCANNER_AUTO, text, text_size, threads, count);
+        }
+    }
+    return newline_index_with(NEWLINE_SCANNER_AUTO, text, text_size, count);
+}
+
+// Finish the table the way newline_index documents it
+static size_t *offsets_finish(Offsets *offsets, size_t text_size, size_t *count)
+{
+    // The last start doubles as the end sentinel when the text ends
+    // with '\n'; otherwise the unterminated last line needs one.
+    if (offsets->items[offsets->count - 1] != text_size) {
+        offsets_push(offsets, text_size);
+    }
+
+    *count = offsets->count - 1;
+    return offsets->items;
+}
+
+size_t *newline_index_with(Newline_Scanner scanner, const char *text, size_t text_size, size_t *count)
+{
+    Offsets offsets = {0};
+    offsets_push(&offsets, 0);
+    index_range(newline_scanner_func(scanner), text, 0, text_size, 1, &offsets);
+    return offsets_finish(&offsets, text_size, count);
+}
+
+// Same table as newline_index_with, built by scanning `threads` slices of
+// the text concurrently and stitching the per-slice tables together.
+size_t *newline_index_parallel(Newline_Scanner scanner, const char *text, size_t text_size, size_t threads, size_t *count)
+{
+    Offsets offsets = {0};
+    offsets_push(&offsets, 0);
+    index_range(newline_scanner_func(scanner), text, 0, text_size, threads, &offsets);
+    return offsets_finish(&offsets, text_size, count);
+}
+
+// Offsets right after every '\n' in text[begin..end), for indexing a
+// text piece by piece. Large ranges are scanned on one thread per core.
+size_t *newline_index_range(const char *text, size_t begin, size_t end, size_t *count)
+{
+    TRACE_FUNCTION();
+    const size_t threads = end - begin >= NEWLINE_INDEX_PARALLEL_MIN_SIZE ? newline_index_default_threads() : 1;
+
+    Offsets offsets = {0};
+    index_range(newline_scanner_func(NEWLINE_SCANNER_AUTO), text, begin, end, threads, &offsets);
+    *count = offsets.count;
+    return offsets.items;
+}
@@ -0,0 +1,27 @@
+#ifndef NEWLINE_INDEX_H_
+#define NEWLINE_INDEX_H_
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef enum {
+    NEWLINE_SCANNER_AUTO = 0,
+    NEWLINE_SCANNER_SCALAR,
+    NEWLINE_SCANNER_SSE2,
+    NEWLINE_SCANNER_AVX2,
+    COUNT_NEWLINE_SCANNERS,
+} Newline_Scanner;
+
+// Line starts of `text`: returns `*count + 1` offsets where line i spans
+// [starts[i], starts[i + 1]) including its '\n', and starts[*count] is
+// `text_size`. A trailing line without '\n' still counts as a line.
+// Large texts are scanned on one thread per core.
+size_t *newline_index(const char *text, size_t text_size, size_t *count);
+size_t *newline_index_with(Newline_Scanner scanner, const char *text, size_t text_size, size_t *count);
+size_t *newline_index_parallel(Newline_Scanner scanner, const char *text, size_t text_size, size_t threads, size_t *count);
+size_t *newline_index_range(const char *text, size_t begin, size_t end, size_t *count);
+size_t newline_index_default_threads(void);
+
+bool newline_scanner_supported(Newline_Scanner scanner);
+const char *newline_scanner_name(Newline_Scanner scanner);
+
+#endif // NEWLINE_INDEX_H_
@@ -0,0 +1,367 @@
+#include <string.h>
+#include <assert.h>
+#include "./piece_table.h"
+#include "./newline_index.h"
+
+#define ADDED_INIT_CAPACITY 128
+
+static size_t piece_table_piece_bytes(const Piece_Table *pt, Piece piece)
+{
+    if (piece.source == PIECE_ADDED) {
+        assert(piece.count == 1);
+        size_t ending = 0;
+        line_ending_text(pt->added_endings[piece.start], &ending);
+        return pt->added[piece.start].size + ending;
+    }
+    return pt->original_starts[piece.start + piece.count] - pt->original_starts[piece.start];
+}
+
+// Make sure a piece starts exactly at `row`
+static void piece_table_cut(Piece_Table *pt, size_t row)
+{
+    if (row >= piece_table_rows(pt)) {
+        return;
+    }
+
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+    if (offset == 0) {
+        return;
+    }
+
+    const size_t first = row - offset;
+    const Piece head = {
+        .source = piece.source,
+        .start = piece.start,
+        .count = offset,
+    };
+    const Piece tail = {
+        .source = piece.source,
+        .start = piece.start + offset,
+        .count = piece.count - offset,
+    };
+    line_index_remove(&pt->index, first);
+    line_index_insert(&pt->index, first, tail, piece_table_piece_bytes(pt, tail));
+    line_index_insert(&pt->index, first, head, piece_table_piece_bytes(pt, head));
+}
+
+static size_t piece_table_append_line(Piece_Table *pt)
+{
+    if (pt->added_count >= pt->added_capacity) {
+        pt->added_capacity = pt->added_capacity == 0 ? ADDED_INIT_CAPACITY : pt->added_capacity * 2;
+        pt->added = realloc(pt->added, pt->added_capacity * sizeof(pt->added[0]));
+        pt->added_versions = realloc(pt->added_versions, pt->added_capacity * sizeof(pt->added_versions[0]));
+        pt->added_endings = realloc(pt->added_endings, pt->added_capacity * sizeof(pt->added_endings[0]));
+        assert(pt->added != NULL && pt->added_versions != NULL && pt->added_endings != NULL);
+    }
+
+    pt->added[pt->added_count] = (Line) {
+        .slab = &pt->slab,
+    };
+    pt->added_versions[pt->added_count] = ++pt->last_version;
+    pt->added_endings[pt->added_count] = LINE_ENDING_LF;
+    return pt->added_count++;
+}
+
+void piece_table_load(Piece_Table *pt, const char *text, size_t text_size)
+{
+    piece_table_free(pt);
+
+    pt->original = text;
+    pt->original_size = text_size;
+    pt->original_starts = newline_index(text, text_size, &pt->original_count);
+    pt->original_capacity = pt->original_count + 1;
+    pt->original_end = text_size;
+
+    if (pt->original_count > 0) {
+        const Piece piece = {
+            .source = PIECE_ORIGINAL,
+            .start = 0,
+            .count = pt->original_count,
+        };
+        line_index_insert(&pt->index, 0, piece, piece_table_piece_bytes(pt, piece));
+    }
+}
+
+// Start with none of `text` indexed; its rows are added as they are found
+// with piece_table_append_original.
+void piece_table_load_lazy(Piece_Table *pt, const char *text, size_t text_size)
+{
+    piece_table_free(pt);
+
+    pt->original = text;
+    pt->original_size = text_size;
+    pt->original_capacity = 1024;
+    pt->original_starts = malloc(pt->original_capacity * sizeof(pt->original_starts[0]));
+    assert(pt->original_starts != NULL);
+    pt->original_starts[0] = 0;
+}
+
+// Append the next `count` rows of the original text to the end of the
+// document. `starts` holds where the row after each of them begins. The
+// text from the last of them up to `end` becomes the growing last row.
+void piece_table_append_original(Piece_Table *pt, const size_t *starts, size_t count, size_t end)
+{
+    if (count == 0 && end == pt->original_end) {
+        return;
+    }
+
+    if (pt->has_tail) {
+        line_index_remove(&pt->index, piece_table_rows(pt) - 1);
+        pt->has_tail = false;
+    }
+
+    // One more for the end of the tail
+    const size_t needed = pt->original_count + count + 2;
+    if (needed > pt->original_capacity) {
+        while (needed > pt->original_capacity) {
+            pt->original_capacity *= 2;
+        }
+        pt->original_starts = realloc(pt->original_starts, pt->original_capacity * sizeof(pt->original_starts[0]));
+        assert(pt->original_starts != NULL);
+    }
+    memcpy(pt->original_starts + pt->original_count + 1, starts, count * sizeof(starts[0]));
+
+    if (count > 0) {
+        const Piece piece = {
+            .source = PIECE_ORIGINAL,
+            .start = pt->original_count,
+            .count = count,
+        };
+        pt->original_count += count;
+        line_index_insert(&pt->index, piece_table_rows(pt), piece, piece_table_piece_bytes(pt, piece));
+    }
+
+    pt->original_end = end;
+    if (end > pt->original_starts[pt->original_count]) {
+        pt->original_starts[pt->original_count + 1] = end;
+        const Piece tail = {
+            .source = PIECE_ORIGINAL,
+            .start = pt->original_count,
+            .count = 1,
+        };
+        line_index_insert(&pt->index, piece_table_rows(pt), tail, piece_table_piece_bytes(pt, tail));
+        pt->has_tail = true;
+        pt->tail_version = ++pt->last_version;
+    }
+}
+
+void piece_table_free(Piece_Table *pt)
+{
+    slab_release(&pt->slab);
+    free(pt->added);
+    free(pt->added_versions);
+    free(pt->added_endings);
+    line_index_free(&pt->index);
+    free(pt->original_starts);
+    memset(pt, 0, sizeof(*pt));
+}
+
+size_t piece_table_rows(const Piece_Table *pt)
+{
+    return line_index_rows(&pt->index);
+}
+
+size_t piece_table_bytes(const Piece_Table *pt)
+{
+    return line_index_bytes(&pt->index);
+}
+
+// Row that holds byte offset `byte` of the document
+size_t piece_table_row_at_byte(const Piece_Table *pt, size_t byte)
+{
+    size_t row = 0;
+    size_t piece_byte = 0;
+    const Piece piece = line_index_find_byte(&pt->index, byte, &row, &piece_byte);
+    if (piece.source == PIECE_ADDED) {
+        return row;
+    }
+
+    // Binary search the line starts covered by the piece
+    const size_t target = pt->original_starts[piece.start] + (byte - piece_byte);
+    size_t lo = piece.start;
+    size_t hi = piece.start + piece.count;
+    while (hi - lo > 1) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (pt->original_starts[mid] <= target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return row + (lo - piece.start);
+}
+
+// Read-only view of a row. Rows that were never edited are viewed
+// straight from the original buffer.
+Line piece_table_peek_line(const Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+
+    if (piece.source == PIECE_ADDED) {
+        return pt->added[piece.start];
+    }
+
+    const size_t index = piece.start + offset;
+    const size_t begin = pt->original_starts[index];
+    size_t end = pt->original_starts[index + 1];
+    if (end > begin && pt->original[end - 1] == '\n') end -= 1;
+    if (end > begin && pt->original[end - 1] == '\r') end -= 1;
+
+    return line_view(pt->original + begin, end - begin);
+}
+
+// Editable row. An original row is copied into the add buffer the first
+// time it is edited. The pointer is only valid until the next insertion,
+// and piece_table_update_line must be called after changing its size.
+Line *piece_table_line(Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+
+    if (piece.source == PIECE_ADDED) {
+        return &pt->added[piece.start];
+    }
+
+    const Line view = piece_table_peek_line(pt, row);
+    const Line_Ending ending = piece_table_line_ending(pt, row);
+    piece_table_delete_line(pt, row);
+    Line *line = piece_table_insert_line(pt, row);
+    line_join(line, &view);
+    pt->added_endings[line - pt->added] = ending;
+    piece_table_update_line(pt, row);
+    return line;
+}
+
+Line *piece_table_insert_line(Piece_Table *pt, size_t row)
+{
+    assert(row <= piece_table_rows(pt));
+
+    const size_t added = piece_table_append_line(pt);
+    const Piece piece = {
+        .source = PIECE_ADDED,
+        .start = added,
+        .count = 1,
+    };
+    piece_table_cut(pt, row);
+    line_index_insert(&pt->index, row, piece, piece_table_piece_bytes(pt, piece));
+    return &pt->added[added];
+}
+
+void piece_table_delete_line(Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+
+    if (piece.source == PIECE_ADDED) {
+        line_free(&pt->added[piece.start]);
+    } else {
+        piece_table_cut(pt, row);
+        piece_table_cut(pt, row + 1);
+    }
+    line_index_remove(&pt->index, row);
+}
+
+// Refresh the byte count and version of an edited row
+void piece_table_update_line(Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+    line_index_set_bytes(&pt->index, row, piece_table_piece_bytes(pt, piece));
+    if (piece.source == PIECE_ADDED) {
+        pt->added_versions[piece.start] = ++pt->last_version;
+    }
+}
+
+// Number that changes whenever the text of the row does. Two rows with
+// the same version hold the same text, so it can key caches of anything
+// derived from the text. Original rows are numbered by their position in
+// the original text (even), edited rows by their last edit (odd).
+// Versions are only comparable within one loaded document.
+uint64_t piece_table_line_version(const Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+    if (piece.source == PIECE_ADDED) {
+        return pt->added_versions[piece.start] * 2 + 1;
+    }
+    // The tail changes as it grows
+    if (pt->has_tail && piece.start + offset == pt->original_count) {
+        return pt->tail_version * 2 + 1;
+    }
+    return (piece.start + offset) * 2;
+}
+
+// Number that names the row while it is edited: the same for every
+// version of an edited row, and for an original row, its version. Rows
+// keep their id when rows above them are inserted or deleted.
+uint64_t piece_table_line_id(const Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+    if (piece.source == PIECE_ADDED) {
+        return piece.start * 2 + 1;
+    }
+    return (piece.start + offset) * 2;
+}
+
+// How the row ends: as it did in the original text, or as set on the
+// edited row
+Line_Ending piece_table_line_ending(const Piece_Table *pt, size_t row)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+    if (piece.source == PIECE_ADDED) {
+        return pt->added_endings[piece.start];
+    }
+
+    const size_t index = piece.start + offset;
+    const size_t begin = pt->original_starts[index];
+    const size_t end = pt->original_starts[index + 1];
+    if (end == begin || pt->original[end - 1] != '\n') {
+        return LINE_ENDING_NONE;
+    }
+    if (end - begin >= 2 && pt->original[end - 2] == '\r') {
+        return LINE_ENDING_CRLF;
+    }
+    return LINE_ENDING_LF;
+}
+
+// Change the ending of an edited row
+void piece_table_set_line_ending(Piece_Table *pt, size_t row, Line_Ending ending)
+{
+    size_t offset = 0;
+    const Piece piece = line_index_find(&pt->index, row, &offset, NULL);
+    assert(piece.source == PIECE_ADDED);
+    pt->added_endings[piece.start] = ending;
+    // The text and so the version stay the same
+    line_index_set_bytes(&pt->index, row, piece_table_piece_bytes(pt, piece));
+}
+
+const char *line_ending_text(Line_Ending ending, size_t *size)
+{
+    switch (ending) {
+    case LINE_ENDING_NONE: *size = 0; return "";
+    case LINE_ENDING_CRLF: *size = 2; return "\r\n";
+    case LINE_ENDING_LF: break;
+    }
+    *size = 1;
+    return "\n";
+}
+
+// Heap bytes held by edited rows beyond their text, plus unused slots
+// of the add buffer
+size_t piece_table_slack_bytes(const Piece_Table *pt)
+{
+    size_t slack = (pt->added_capacity - pt->added_count) * sizeof(pt->added[0]);
+    for (size_t i = 0; i < pt->added_count; ++i) {
+        slack += line_slack(&pt->added[i]);
+    }
+    return slack;
+}
+
+Slab_Stats piece_table_slab_stats(const Piece_Table *pt)
+{
+    return slab_stats(&pt->slab);
+}
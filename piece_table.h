@@ -0,0 +1,69 @@
+#ifndef PIECE_TABLE_H_
+#define PIECE_TABLE_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "./line.h"
+#include "./line_index.h"
+#include "./slab.h"
+
+// Row-level piece table. The original buffer is the read-only text the
+// document was loaded from, indexed by line starts; the add buffer is an
+// append-only array of editable Lines. The document is the concatenation
+// of the pieces, kept in a Line_Index, so inserting or deleting a row
+// only touches O(log pieces) tree nodes and never moves the rows themselves.
+// Untouched rows count their bytes as stored in the original text, edited
+// rows count their text plus their line ending, which is carried over
+// from the original row so saving does not rewrite it. The text of edited
+// rows is allocated from `slab`, so closing a document is a handful of frees.
+typedef enum {
+    LINE_ENDING_LF = 0,
+    LINE_ENDING_NONE,
+    LINE_ENDING_CRLF,
+} Line_Ending;
+
+typedef struct {
+    const char *original;
+    size_t original_size;
+    size_t *original_starts;
+    size_t original_count;
+    size_t original_capacity;
+    // While a file loads, the text after its last indexed row up to
+    // original_end is shown as one more row that grows as it is scanned.
+    // Its text is original_starts[original_count..original_count + 1].
+    bool has_tail;
+    uint64_t tail_version;
+    size_t original_end;
+
+    Line *added;
+    uint64_t *added_versions;
+    Line_Ending *added_endings;
+    size_t added_count;
+    size_t added_capacity;
+    uint64_t last_version;
+    Slab slab;
+
+    Line_Index index;
+} Piece_Table;
+
+void piece_table_load(Piece_Table *pt, const char *text, size_t text_size);
+void piece_table_load_lazy(Piece_Table *pt, const char *text, size_t text_size);
+void piece_table_append_original(Piece_Table *pt, const size_t *starts, size_t count, size_t end);
+void piece_table_free(Piece_Table *pt);
+size_t piece_table_rows(const Piece_Table *pt);
+size_t piece_table_bytes(const Piece_Table *pt);
+size_t piece_table_row_at_byte(const Piece_Table *pt, size_t byte);
+Line piece_table_peek_line(const Piece_Table *pt, size_t row);
+Line *piece_table_line(Piece_Table *pt, size_t row);
+Line *piece_table_insert_line(Piece_Table *pt, size_t row);
+void piece_table_delete_line(Piece_Table *pt, size_t row);
+void piece_table_update_line(Piece_Table *pt, size_t row);
+uint64_t piece_table_line_version(const Piece_Table *pt, size_t row);
+uint64_t piece_table_line_id(const Piece_Table *pt, size_t row);
+Line_Ending piece_table_line_ending(const Piece_Table *pt, size_t row);
+void piece_table_set_line_ending(Piece_Table *pt, size_t row, Line_Ending ending);
+const char *line_ending_text(Line_Ending ending, size_t *size);
+size_t piece_table_slack_bytes(const Piece_Table *pt);
+Slab_Stats piece_table_slab_stats(const Piece_Table *pt);
+
+#endif // PIECE_TABLE_H_
@@ -0,0 +1,241 @@
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <errno.h>
+#include "./replay.h"
+
+static void write_varint(FILE *file, uint64_t value)
+{
+    unsigned char bytes[10];
+    size_t n = 0;
+    do {
+        bytes[n] = value & 0x7f;
+        value >>= 7;
+        if (value) bytes[n] |= 0x80;
+        n += 1;
+    } while (value);
+    fwrite(bytes, 1, n, file);
+}
+
+static bool read_varint(const Replay *replay, size_t *pos, uint64_t *value)
+{
+    *value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (*pos >= replay->size) return false;
+        const unsigned char byte = replay->data[(*pos)++];
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool recorder_open(Recorder *recorder, const char *file_path)
+{
+    *recorder = (Recorder) {0};
+    recorder->file = fopen(file_path, "wb");
+    if (recorder->file == NULL) {
+        fprintf(stderr, "ERROR: could not create %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+    fwrite(REPLAY_MAGIC, 1, strlen(REPLAY_MAGIC), recorder->file);
+    recorder->last_ticks = SDL_GetTicks();
+    return true;
+}
+
+// Events ted does not react to, or that depend on the window it runs in,
+// are left out
+void recorder_record(Recorder *recorder, const SDL_Event *event)
+{
+    if (recorder->file == NULL) return;
+
+    Replay_Kind kind;
+    switch (event->type) {
+    case SDL_KEYDOWN:    kind = REPLAY_KEYDOWN;    break;
+    case SDL_KEYUP:      kind = REPLAY_KEYUP;      break;
+    case SDL_TEXTINPUT:  kind = REPLAY_TEXTINPUT;  break;
+    case SDL_MOUSEWHEEL: kind = REPLAY_MOUSEWHEEL; break;
+    case SDL_QUIT:       kind = REPLAY_QUIT;       break;
+    default: return;
+    }
+
+    // Timestamps of queued events can lag behind the last one recorded
+    const Uint32 now = SDL_GetTicks();
+    write_varint(recorder->file, now > recorder->last_ticks ? now - recorder->last_ticks : 0);
+    if (now > recorder->last_ticks) recorder->last_ticks = now;
+    fputc(kind, recorder->file);
+
+    switch (kind) {
+    case REPLAY_KEYDOWN:
+    case REPLAY_KEYUP: {
+        write_varint(recorder->file, (uint32_t) event->key.keysym.sym);
+        write_varint(recorder->file, event->key.keysym.mod);
+        break;
+    }
+    case REPLAY_TEXTINPUT: {
+        const size_t len = strnlen(event->text.text, sizeof(event->text.text) - 1);
+        fputc(len, recorder->file);
+        fwrite(event->text.text, 1, len, recorder->file);
+        break;
+    }
+    case REPLAY_MOUSEWHEEL: {
+        const int32_t y = event->wheel.y;
+        write_varint(recorder->file, ((uint32_t) y << 1) ^ (uint32_t) (y >> 31));
+        break;
+    }
+    case REPLAY_QUIT: break;
+    }
+    recorder->events += 1;
+}
+
+void recorder_close(Recorder *recorder)
+{
+    if (recorder->file) {
+        if (fclose(recorder->file) != 0) {
+            fprintf(stderr, "ERROR: could not write the recording: %s\n", strerror(errno));
+        }
+    }
+    *recorder = (Recorder) {0};
+}
+
+// Decode the event at `*pos` into `event` (which may be NULL) and move
+// past it. Returns false if the data is cut short or malformed.
+static bool replay_decode(const Replay *replay, size_t *pos, Uint32 *delta, SDL_Event *event)
+{
+    uint64_t value = 0;
+    if (!read_varint(replay, pos, &value) || *pos >= replay->size) return false;
+    *delta = value;
+
+    SDL_Event decoded = {0};
+    switch (replay->data[(*pos)++]) {
+    case REPLAY_KEYDOWN:
+    case REPLAY_KEYUP: {
+        decoded.type = replay->data[*pos - 1] == REPLAY_KEYDOWN ? SDL_KEYDOWN : SDL_KEYUP;
+        if (!read_varint(replay, pos, &value)) return false;
+        decoded.key.keysym.sym = (SDL_Keycode) (uint32_t) value;
+        if (!read_varint(replay, pos, &value)) return false;
+        decoded.key.keysym.mod = value;
+        decoded.key.state = decoded.type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED;
+        break;
+    }
+    case REPLAY_TEXTINPUT: {
+        if (*pos >= replay->size) return false;
+        const size_t len = replay->data[(*pos)++];
+        if (len >= sizeof(decoded.text.text) || replay->size - *pos < len) return false;
+        decoded.type = SDL_TEXTINPUT;
+        memcpy(decoded.text.text, replay->data + *pos, len);
+        *pos += len;
+        break;
+    }
+    case REPLAY_MOUSEWHEEL: {
+        if (!read_varint(replay, pos, &value)) return false;
+        decoded.type = SDL_MOUSEWHEEL;
+        decoded.wheel.y = (int32_t) ((uint32_t) value >> 1) ^ -(int32_t) (value & 1);
+        break;
+    }
+    case REPLAY_QUIT: {
+        decoded.type = SDL_QUIT;
+        break;
+    }
+    default: return false;
+    }
+
+    if (event) *event = decoded;
+    return true;
+}
+
+bool replay_load(Replay *replay, const char *file_path)
+{
+    *replay = (Replay) {0};
+
+    FILE *file = fopen(file_path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open %s: %s\n", file_path, strerror(errno));
+        return false;
+    }
+
+    size_t capacity = 64 * 1024;
+    replay->data = malloc(capacity);
+    assert(replay->data != NULL);
+    size_t n = 0;
+    while ((n = fread(replay->data + replay->size, 1, capacity - replay->size, file)) > 0) {
+        replay->size += n;
+        if (replay->size == capacity) {
+            capacity *= 2;
+            replay->data = realloc(replay->data, capacity);
+            assert(replay->data != NULL);
+        }
+    }
+    const bool read_failed = ferror(file);
+    fclose(file);
+    if (read_failed) {
+        fprintf(stderr, "ERROR: could not read %s: %s\n", file_path, strerror(errno));
+        replay_free(replay);
+        return false;
+    }
+
+    const size_t magic_size = strlen(REPLAY_MAGIC);
+    if (replay->size < magic_size || memcmp(replay->data, REPLAY_MAGIC, magic_size) != 0) {
+        fprintf(stderr, "ERROR: %s is not a ted recording\n", file_path);
+        replay_free(replay);
+        return false;
+    }
+
+    // Check the whole recording up front so playback never stops halfway
+    size_t pos = magic_size;
+    while (pos < replay->size) {
+        Uint32 delta = 0;
+        if (!replay_decode(replay, &pos, &delta, NULL)) {
+            fprintf(stderr, "ERROR: %s is corrupted after %zu events\n", file_path, replay->events);
+            replay_free(replay);
+            return false;
+        }
+        replay->events += 1;
+    }
+
+    replay->pos = magic_size;
+    return true;
+}
+
+bool replay_done(const Replay *replay)
+{
+    return replay->pos >= replay->size;
+}
+
+// Milliseconds from the start of the recording to the next event
+Uint32 replay_next_ticks(const Replay *replay)
+{
+    size_t pos = replay->pos;
+    Uint32 delta = 0;
+    replay_decode(replay, &pos, &delta, NULL);
+    return replay->ticks + delta;
+}
+
+// The next recorded event, stamped with the current time
+bool replay_next(Replay *replay, SDL_Event *event)
+{
+    if (replay_done(replay)) return false;
+
+    Uint32 delta = 0;
+    if (!replay_decode(replay, &replay->pos, &delta, event)) {
+        replay->pos = replay->size;
+        return false;
+    }
+    replay->ticks += delta;
+
+    const Uint32 now = SDL_GetTicks();
+    switch (event->type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:      event->key.timestamp = now;   break;
+    case SDL_TEXTINPUT:  event->text.timestamp = now;  break;
+    case SDL_MOUSEWHEEL: event->wheel.timestamp = now; break;
+    default: break;
+    }
+    return true;
+}
+
+void replay_free(Replay *replay)
+{
+    free(replay->data);
+    *replay = (Replay) {0};
+}
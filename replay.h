@@ -0,0 +1,52 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <SDL2/SDL.h>
+
+#define REPLAY_MAGIC "TEDREC1\n"
+
+typedef enum {
+    REPLAY_KEYDOWN = 1,
+    REPLAY_KEYUP,
+    REPLAY_TEXTINPUT,
+    REPLAY_MOUSEWHEEL,
+    REPLAY_QUIT,
+} Replay_Kind;
+
+// Writes the input events ted reacts to, so a session can be played back.
+// After REPLAY_MAGIC every event is the milliseconds since the previous
+// one as a varint, a Replay_Kind byte and then:
+//   key down/up  keycode and modifiers as varints
+//   text input   a length byte and the UTF-8 bytes
+//   mouse wheel  y as a zigzag varint
+// so a typical keystroke takes four bytes.
+typedef struct {
+    FILE *file;
+    Uint32 last_ticks;
+    size_t events;
+} Recorder;
+
+bool recorder_open(Recorder *recorder, const char *file_path);
+void recorder_record(Recorder *recorder, const SDL_Event *event);
+void recorder_close(Recorder *recorder);
+
+// A recording loaded into memory, handed out one event at a time
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t pos;
+    // Milliseconds from the start of the recording to the last event
+    // handed out
+    Uint32 ticks;
+    size_t events;
+} Replay;
+
+bool replay_load(Replay *replay, const char *file_path);
+bool replay_done(const Replay *replay);
+Uint32 replay_next_ticks(const Replay *replay);
+bool replay_next(Replay *replay, SDL_Event *event);
+void replay_free(Replay *replay);
+
+#endif // REPLAY_H_
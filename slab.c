@@ -0,0 +1,145 @@
+#include <assert.h>
+#include "./slab.h"
+
+struct Slab_Chunk {
+    Slab_Chunk *next;
+    size_t used;
+};
+
+struct Slab_Block {
+    Slab_Block *prev;
+    Slab_Block *next;
+    size_t size;
+};
+
+static size_t slab_class(size_t size)
+{
+    size_t class = 0;
+    while (class < SLAB_CLASSES && (size_t) SLAB_MIN_CLASS << class < size) {
+        class += 1;
+    }
+    return class;
+}
+
+static void slab_push_free(Slab *slab, size_t class, void *ptr)
+{
+    *(void **) ptr = slab->free_lists[class];
+    slab->free_lists[class] = ptr;
+}
+
+static char *slab_chunk_data(Slab_Chunk *chunk)
+{
+    return (char *) (chunk + 1);
+}
+
+// Hand what is left of the current chunk to the free lists
+static void slab_retire_chunk(Slab *slab, Slab_Chunk *chunk)
+{
+    for (size_t class = SLAB_CLASSES; class-- > 0;) {
+        const size_t block_size = (size_t) SLAB_MIN_CLASS << class;
+        while (SLAB_CHUNK_SIZE - chunk->used >= block_size) {
+            slab_push_free(slab, class, slab_chunk_data(chunk) + chunk->used);
+            chunk->used += block_size;
+        }
+    }
+}
+
+static void *slab_alloc_large(Slab *slab, size_t size)
+{
+    Slab_Block *block = malloc(sizeof(*block) + size);
+    assert(block != NULL);
+    block->prev = NULL;
+    block->next = slab->large;
+    block->size = size;
+    if (slab->large) slab->large->prev = block;
+    slab->large = block;
+
+    slab->live_bytes += size;
+    slab->reserved_bytes += size;
+    return block + 1;
+}
+
+static void slab_free_large(Slab *slab, void *ptr)
+{
+    Slab_Block *block = (Slab_Block *) ptr - 1;
+    if (block->prev) block->prev->next = block->next;
+    else slab->large = block->next;
+    if (block->next) block->next->prev = block->prev;
+
+    slab->live_bytes -= block->size;
+    slab->reserved_bytes -= block->size;
+    free(block);
+}
+
+// Allocate a block of at least `size` bytes. Sizes are rounded up to the
+// next class, so pass power-of-two sizes to avoid waste.
+void *slab_alloc(Slab *slab, size_t size)
+{
+    const size_t class = slab_class(size);
+    if (class == SLAB_CLASSES) {
+        return slab_alloc_large(slab, size);
+    }
+
+    const size_t block_size = (size_t) SLAB_MIN_CLASS << class;
+    slab->live_bytes += block_size;
+
+    void *ptr = slab->free_lists[class];
+    if (ptr) {
+        slab->free_lists[class] = *(void **) ptr;
+        return ptr;
+    }
+
+    Slab_Chunk *chunk = slab->chunks;
+    if (chunk == NULL || SLAB_CHUNK_SIZE - chunk->used < block_size) {
+        if (chunk) slab_retire_chunk(slab, chunk);
+
+        chunk = malloc(sizeof(*chunk) + SLAB_CHUNK_SIZE);
+        assert(chunk != NULL);
+        chunk->next = slab->chunks;
+        chunk->used = 0;
+        slab->chunks = chunk;
+        slab->reserved_bytes += SLAB_CHUNK_SIZE;
+    }
+
+    ptr = slab_chunk_data(chunk) + chunk->used;
+    chunk->used += block_size;
+    return ptr;
+}
+
+// Return a block; `size` must be the size it was allocated with
+void slab_free(Slab *slab, void *ptr, size_t size)
+{
+    const size_t class = slab_class(size);
+    if (class == SLAB_CLASSES) {
+        slab_free_large(slab, ptr);
+        return;
+    }
+
+    slab->live_bytes -= (size_t) SLAB_MIN_CLASS << class;
+    slab_push_free(slab, class, ptr);
+}
+
+// Free every block at once
+void slab_release(Slab *slab)
+{
+    while (slab->chunks) {
+        Slab_Chunk *next = slab->chunks->next;
+        free(slab->chunks);
+        slab->chunks = next;
+    }
+    while (slab->large) {
+        Slab_Block *next = slab->large->next;
+        free(slab->large);
+        slab->large = next;
+    }
+    *slab = (Slab) {0};
+}
+
+Slab_Stats slab_stats(const Slab *slab)
+{
+    return (Slab_Stats) {
+        .live_bytes = slab->live_bytes,
+        .free_bytes = slab->reserved_bytes - slab->live_bytes,
+        .reserved_bytes = slab->reserved_bytes,
+    };
+}
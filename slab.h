@@ -0,0 +1,35 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+#include <stdlib.h>
+
+#define SLAB_MIN_CLASS 32
+#define SLAB_CLASSES 12 // 32 bytes .. 64 KiB
+#define SLAB_CHUNK_SIZE (1024 * 1024)
+
+typedef struct Slab_Chunk Slab_Chunk;
+typedef struct Slab_Block Slab_Block;
+
+// Size-class allocator for line text. Blocks of power-of-two sizes are
+// carved out of large chunks and recycled through per-class free lists;
+// anything above the largest class gets its own tracked allocation.
+// slab_release frees the whole document in one pass over the chunks.
+typedef struct {
+    void *free_lists[SLAB_CLASSES];
+    Slab_Chunk *chunks;
+    Slab_Block *large;
+    size_t live_bytes;
+    size_t reserved_bytes;
+} Slab;
+
+typedef struct {
+    size_t live_bytes;
+    size_t free_bytes;
+    size_t reserved_bytes;
+} Slab_Stats;
+
+void *slab_alloc(Slab *slab, size_t size);
+void slab_free(Slab *slab, void *ptr, size_t size);
+void slab_release(Slab *slab);
+Slab_Stats slab_stats(const Slab *slab);
+
+#endif // SLAB_H_
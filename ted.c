@@ -3,14 +3,22 @@
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 #include <SDL2/SDL.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "./stb_image.h"
 #include "./v2.h"
 #include "./editor.h"
+#include "./line_cache.h"
+#include "./glyph_atlas.h"
+#include "./trace.h"
+#include "./replay.h"
+#include "./utf8.h"
+#include "./cp437.h"
 
 #define FONT "./font/8x8.png"
+#define TRUETYPE_FONT "./perfect_dos_font/PerfectDOSVGA437.ttf"
 #define FONT_COLS 16
 #define FONT_ROWS 16
 #define FONT_WIDTH 128
@@ -22,13 +30,22 @@
 #define MAX_NUMBER_CHAR_HEIGHT 24
 #define WINDOW_WIDTH  (FONT_CHAR_WIDTH * MAX_NUMBER_CHAR_WIDTH * FONT_SCALE)
 #define WINDOW_HEIGHT (FONT_CHAR_HEIGHT * MAX_NUMBER_CHAR_WIDTH * FONT_SCALE)
-#define ASCII_TABLE_SIZE 128
 
 #define UNPACK_RGBA(color)  (Uint8)(color>>24),(Uint8)(color>>16),(Uint8)(color>>8),(color&0xff)
 #define UNPACK_RGB(color) (Uint8)(color>>24),(Uint8)(color>>16),(Uint8)(color>>8)
 #define UNPACK_ALPHA(color) (color&0xff)
 
 #define BACKGROUND_COLOR 0x3c3c3cff
+// How often to redraw while a file loads or saves in the background
+#define BUSY_FRAME_MS 30
+#define HEADLESS_DEFAULT_FRAMES 100
+#define HUD_FRAMES 120
+#define HUD_BUDGET_SECS (1.0 / 60.0)
+#define LINE_CACHE_MAX_ENTRIES 4096
+#define LINE_CACHE_MAX_BYTES (64 * 1024 * 1024)
+// Line textures are allocated in steps of this many columns, so a row
+// that grows as it is typed keeps drawing into the same texture
+#define LINE_TEXTURE_COLUMN_STEP 16
 
 // Global variables (at the moment...)
 Editor editor = {0};
@@ -37,10 +54,70 @@ size_t cursor = 0;
 float zoom_factor = 1.0;
 
 typedef struct {
+    // A 16x16 grid of the code page 437 characters
     SDL_Texture *spritesheet;
-    SDL_Rect glyph_table[ASCII_TABLE_SIZE];
+    // TrueType fonts draw from `atlas` instead of the spritesheet, with
+    // every glyph baked at the zoomed size
+    bool truetype;
+    Glyph_Atlas atlas;
+
+    // Glyph quads queued for the next render_flush, with the atlas page
+    // of each. `indices` is filled in for one page at a time.
+    SDL_Vertex *vertices;
+    int *indices;
+    Uint8 *pages;
+    size_t glyph_count;
+    size_t glyph_capacity;
+    // Glyphs left out this frame because the atlas had no time to bake them
+    size_t missing;
 } Font;
 
+typedef struct {
+    size_t wakeups;
+    size_t frames;
+    size_t glyphs;
+    size_t draw_calls;
+    size_t rows_painted;
+    double frame_secs;
+    // From the oldest input event of a frame to its present
+    size_t input_frames;
+    Uint32 input_latency_ms;
+    Uint32 max_input_latency_ms;
+} Render_Stats;
+
+Render_Stats render_stats = {0};
+
+// Where the time of one frame went, in seconds
+typedef struct {
+    double events;
+    double layout;
+    double render;
+    double present;
+} Frame_Times;
+
+// Overlay with the times of the last HUD_FRAMES frames, toggled with F1
+typedef struct {
+    bool visible;
+    Frame_Times frames[HUD_FRAMES];
+    size_t count;
+    Uint32 input_latency_ms;
+} Hud;
+
+Hud hud = {0};
+
+// Input written with --record, or played back with --replay: as fast as
+// possible with a frame drawn after every event, or with --realtime at
+// the pace it was recorded
+Recorder recorder = {0};
+Replay replay = {0};
+bool replay_realtime = false;
+Uint32 replay_start = 0;
+
+double secs_between(Uint64 start, Uint64 end)
+{
+    return (double) (end - start) / SDL_GetPerformanceFrequency();
+}
+
 void sdl_check_code(int code)
 {
     if (code < 0) {
@@ -93,108 +170,634 @@ SDL_Surface *get_suface_from_file(const char *file_path)
 
 Font font_load_from_file(const char *filepath, SDL_Renderer *renderer, Uint32 colorKey)
 {
+    TRACE_FUNCTION();
     Font font = {0};
     SDL_Surface *font_surface = sdl_check_pointer(get_suface_from_file(filepath));
     SDL_SetColorKey(font_surface, SDL_TRUE, colorKey);
     font.spritesheet = sdl_check_pointer(SDL_CreateTextureFromSurface(renderer, font_surface));
     SDL_FreeSurface(font_surface);
+    return (font);
+}
 
-    for (size_t idx = 0; idx < ASCII_TABLE_SIZE; ++idx) {
-        const size_t col = idx % FONT_COLS;
-        const size_t row = idx / FONT_ROWS;
-        font.glyph_table[idx]= (SDL_Rect) { .x = col * FONT_CHAR_WIDTH, .y = row * FONT_CHAR_HEIGHT, .w = FONT_CHAR_WIDTH, .h = FONT_CHAR_HEIGHT };
+Font font_load_truetype(const char *filepath, SDL_Renderer *renderer)
+{
+    TRACE_FUNCTION();
+    Font font = {0};
+    // The bundled font keeps code page 437 artwork in its byte slots
+    if (!glyph_atlas_open(&font.atlas, renderer, filepath, true)) {
+        exit(1);
     }
-
-    return (font);
+    // Wakes the event loop when glyphs it is waiting for are baked
+    const Uint32 ready_event = SDL_RegisterEvents(1);
+    font.atlas.ready_event = ready_event == (Uint32) -1 ? 0 : ready_event;
+    font.truetype = true;
+    return font;
 }
 
-void set_texture_color(SDL_Texture *texture, Uint32 color)
+// Whole pixel sizes of a character cell at the current zoom, worked out
+// once per zoom change so placing glyphs takes no float math
+typedef struct {
+    float zoom_factor;
+    // Size of a bitmap glyph quad; TrueType glyphs are baked glyph_height
+    // pixels high
+    int glyph_width;
+    int glyph_height;
+    // Distance between columns and between rows
+    int advance;
+    int line_height;
+    int cursor_width;
+    int cursor_height;
+} Layout;
+
+Layout layout = {0};
+
+void layout_update(Font *font)
 {
-    sdl_check_code(SDL_SetTextureColorMod(texture, UNPACK_RGB(color)));
-    sdl_check_code(SDL_SetTextureAlphaMod(texture, UNPACK_ALPHA(color)));
+    layout.zoom_factor = zoom_factor;
+    layout.glyph_width = (int) roundf(FONT_CHAR_WIDTH * FONT_SCALE * zoom_factor);
+    layout.glyph_height = (int) roundf(FONT_CHAR_HEIGHT * FONT_SCALE * zoom_factor);
+    layout.advance = font->truetype
+        ? glyph_atlas_size(&font->atlas, layout.glyph_height)->advance
+        : layout.glyph_width;
+    layout.line_height = layout.glyph_height;
+    layout.cursor_width = layout.advance;
+    layout.cursor_height = layout.line_height;
 }
 
-void render_char(SDL_Renderer *renderer, Font *font, const char c, Vec2f pos)
+// Queue one glyph; nothing is drawn until render_flush. The bitmap font
+// draws what code page 437 has and '?' for everything else.
+void render_char(Font *font, uint32_t codepoint, int x, int y, Uint32 color)
 {
-    const SDL_Rect dst = {
-        .x = (int) floor(pos.x),
-        .y = (int) floor(pos.y),
-        .w = FONT_CHAR_WIDTH * FONT_SCALE,
-        .h = FONT_CHAR_HEIGHT * FONT_SCALE
+    if (font->glyph_count >= font->glyph_capacity) {
+        font->glyph_capacity = font->glyph_capacity == 0 ? 1024 : font->glyph_capacity * 2;
+        font->vertices = realloc(font->vertices, font->glyph_capacity * 4 * sizeof(font->vertices[0]));
+        font->indices = realloc(font->indices, font->glyph_capacity * 6 * sizeof(font->indices[0]));
+        font->pages = realloc(font->pages, font->glyph_capacity * sizeof(font->pages[0]));
+        assert(font->vertices != NULL && font->indices != NULL && font->pages != NULL);
+    }
+
+    int cell = cp437_from_codepoint(codepoint);
+    if (cell < 0) cell = '?';
+    SDL_Rect src = {
+        .x = cell % FONT_COLS * FONT_CHAR_WIDTH,
+        .y = cell / FONT_COLS * FONT_CHAR_HEIGHT,
+        .w = FONT_CHAR_WIDTH,
+        .h = FONT_CHAR_HEIGHT,
     };
+    int page = 0;
+    int x0 = x;
+    int y0 = y;
+    int x1 = x0 + layout.glyph_width;
+    int y1 = y0 + layout.glyph_height;
+    if (font->truetype) {
+        // Drawn pixel for pixel, so the glyph is as sharp as it was baked
+        const Atlas_Glyph *glyph = glyph_atlas_get(&font->atlas, codepoint, layout.glyph_height);
+        if (glyph == NULL) {
+            font->missing += 1;
+            return;
+        }
+        if (glyph->rect.w == 0) {
+            return;
+        }
+        src = glyph->rect;
+        page = glyph->page;
+        x0 += glyph->x_offset;
+        y0 += glyph->y_offset;
+        x1 = x0 + src.w;
+        y1 = y0 + src.h;
+    }
+    // Texture coordinates are in pixels until render_flush
+    const float u0 = src.x;
+    const float v0 = src.y;
+    const float u1 = src.x + src.w;
+    const float v1 = src.y + src.h;
+    const SDL_Color tint = { UNPACK_RGBA(color) };
 
-    // assert(index <= ASCII_TABLE_SIZE);
-    const uint8_t index = c % ASCII_TABLE_SIZE;
-    sdl_check_code(SDL_RenderCopy(renderer, font->spritesheet, &font->glyph_table[index], &dst));
+    SDL_Vertex *vertex = font->vertices + font->glyph_count * 4;
+    vertex[0] = (SDL_Vertex) { .position = { x0, y0 }, .color = tint, .tex_coord = { u0, v0 } };
+    vertex[1] = (SDL_Vertex) { .position = { x1, y0 }, .color = tint, .tex_coord = { u1, v0 } };
+    vertex[2] = (SDL_Vertex) { .position = { x0, y1 }, .color = tint, .tex_coord = { u0, v1 } };
+    vertex[3] = (SDL_Vertex) { .position = { x1, y1 }, .color = tint, .tex_coord = { u1, v1 } };
+    font->pages[font->glyph_count] = page;
+
+    font->glyph_count += 1;
+    render_stats.glyphs += 1;
+}
+
+// Draw every queued glyph with one SDL_RenderGeometry call per atlas
+// page. The color of each glyph travels in its vertices, so one call
+// covers all the glyphs of a page.
+void render_flush(SDL_Renderer *renderer, Font *font)
+{
+    if (font->glyph_count == 0) {
+        return;
+    }
+
+    const float width = font->truetype ? GLYPH_ATLAS_PAGE_SIZE : FONT_WIDTH;
+    const float height = font->truetype ? GLYPH_ATLAS_PAGE_SIZE : FONT_HEIGHT;
+    for (size_t i = 0; i < font->glyph_count * 4; ++i) {
+        font->vertices[i].tex_coord.x /= width;
+        font->vertices[i].tex_coord.y /= height;
+    }
+
+    const size_t page_count = font->truetype ? font->atlas.page_count : 1;
+    for (size_t page = 0; page < page_count; ++page) {
+        size_t count = 0;
+        for (size_t i = 0; i < font->glyph_count; ++i) {
+            if (font->pages[i] != page) continue;
+            const int base = i * 4;
+            int *indices = font->indices + count * 6;
+            indices[0] = base + 0;
+            indices[1] = base + 1;
+            indices[2] = base + 2;
+            indices[3] = base + 2;
+            indices[4] = base + 1;
+            indices[5] = base + 3;
+            count += 1;
+        }
+        if (count == 0) continue;
+
+        SDL_Texture *texture = font->truetype ? font->atlas.pages[page].texture : font->spritesheet;
+        sdl_check_code(SDL_RenderGeometry(renderer, texture,
+                                          font->vertices, font->glyph_count * 4,
+                                          font->indices, count * 6));
+        render_stats.draw_calls += 1;
+    }
+    if (font->truetype) {
+        glyph_atlas_drawn(&font->atlas);
+    }
+    font->glyph_count = 0;
 }
 
-void render_text_sized(SDL_Renderer *renderer, Font *font, const char *buffer, size_t buffer_size, Vec2f pos, Uint32 color)
+void render_text_sized(Font *font, const char *buffer, size_t buffer_size, int x, int y, Uint32 color)
 {
-    set_texture_color(font->spritesheet, color);
+    for (size_t i = 0; i < buffer_size;) {
+        const size_t n = utf8_next(buffer + i, buffer_size - i);
+        render_char(font, utf8_decode(buffer + i, n), x, y, color);
+        x += layout.advance;
+        i += n;
+    }
+}
 
-    for (size_t i = 0; i < buffer_size; ++i) {
-        render_char(renderer, font, buffer[i], pos);
-        pos.x += (float) (FONT_CHAR_WIDTH * FONT_SCALE);
+// Render `count` characters of `line` starting with the one at byte
+// `first`. A character may straddle the gap.
+void render_line(Font *font, const Line *line, size_t first, size_t count, int x, int y, Uint32 color)
+{
+    for (size_t col = first; count > 0 && col < line->size; --count) {
+        uint32_t codepoint = 0;
+        col += line_decode(line, col, &codepoint);
+        render_char(font, codepoint, x, y, color);
+        x += layout.advance;
     }
 }
 
 void render_cursor(SDL_Renderer *renderer, Font *font, Uint32 color)
 {
-    const Vec2f pos =
-        vec2f(
-        (float) editor.cursor_col * FONT_CHAR_WIDTH * FONT_SCALE,
-        (float) editor.cursor_row * FONT_CHAR_WIDTH * FONT_SCALE
-        );
+    const size_t column = editor_cursor_column(&editor);
+    if (editor.cursor_row < editor.scroll_row || column < editor.scroll_col) {
+        return;
+    }
 
     SDL_Rect rect = {
-        .x = (int) floorf(pos.x),
-        .y = (int )floorf(pos.y),
-        .w = FONT_CHAR_WIDTH * FONT_SCALE,
-        .h = FONT_CHAR_HEIGHT * FONT_SCALE
+        .x = (column - editor.scroll_col) * layout.advance,
+        .y = (editor.cursor_row - editor.scroll_row) * layout.line_height,
+        .w = layout.cursor_width,
+        .h = layout.cursor_height,
     };
+    // The text queued so far has to land below the cursor
+    render_flush(renderer, font);
     sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(color)));
     sdl_check_code(SDL_RenderFillRect(renderer, &rect));
 
-    const char *c = editor_char_under_cursor(&editor);
-    if (c) {
-        set_texture_color(font->spritesheet, BACKGROUND_COLOR);
-        render_char(renderer, font, *c, pos);
+    uint32_t codepoint = 0;
+    if (editor_char_under_cursor(&editor, &codepoint)) {
+        render_char(font, codepoint, rect.x, rect.y, BACKGROUND_COLOR);
+        render_flush(renderer, font);
     }
+}
 
+// The text rows as last painted, kept between frames so that only the
+// rows that changed have to be drawn again. Anything that moves every
+// row (scrolling, zooming, resizing) repaints the whole layer.
+typedef struct {
+    SDL_Texture *texture;
+    int width;
+    int height;
+    size_t scroll_row;
+    size_t scroll_col;
+    float zoom_factor;
+    bool valid;
+    // Rows [retry_begin, retry_end) were drawn with glyphs missing
+    size_t retry_begin;
+    size_t retry_end;
+    Line_Cache lines;
+} Text_Layer;
+
+// Draw the visible part of a row with a single copy of its cached
+// texture, rendering the texture first if the row is not in the cache
+void render_cached_line(SDL_Renderer *renderer, Font *font, Text_Layer *layer, size_t row, size_t visible_cols, int y, Uint32 color)
+{
+    const size_t columns = editor_line_columns(&editor, row);
+    if (columns <= editor.scroll_col) {
+        return;
+    }
+
+    const Line line = editor_peek_line(&editor, row);
+    const size_t cols = columns - editor.scroll_col < visible_cols ? columns - editor.scroll_col : visible_cols;
+    const Line_Key key = {
+        .line = editor_line_id(&editor, row),
+        .version = editor_line_version(&editor, row),
+        .first_col = editor.scroll_col,
+        .cols = cols,
+        .zoom = layout.zoom_factor,
+        .color = color,
+    };
+    const int width = cols * layout.advance;
+    const int height = layout.line_height;
+    int texture_width = 0;
+    SDL_Texture *texture = line_cache_get(&layer->lines, key, &texture_width);
+    bool cached = texture != NULL;
+    if (texture == NULL) {
+        TRACE_ZONE("line_cache_miss");
+        const size_t missing = font->missing;
+        const size_t texture_cols = (cols + LINE_TEXTURE_COLUMN_STEP - 1) / LINE_TEXTURE_COLUMN_STEP * LINE_TEXTURE_COLUMN_STEP;
+        texture_width = texture_cols * layout.advance;
+        // The texture of the row's previous text is not drawn again
+        texture = line_cache_take_stale(&layer->lines, key, texture_width, height);
+        if (texture == NULL) {
+            texture = sdl_check_pointer(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, texture_width, height));
+            sdl_check_code(SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND));
+        }
+        sdl_check_code(SDL_SetRenderTarget(renderer, texture));
+        sdl_check_code(SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0));
+        sdl_check_code(SDL_RenderClear(renderer));
+        render_line(font, &line, editor_column_to_col(&editor, row, editor.scroll_col), cols, 0, 0, color);
+        render_flush(renderer, font);
+        sdl_check_code(SDL_SetRenderTarget(renderer, layer->texture));
+        // A row with glyphs still to bake is drawn again once they are
+        if (font->missing == missing) {
+            line_cache_put(&layer->lines, key, texture, texture_width, height);
+            cached = true;
+        }
+    }
+
+    const SDL_Rect src = {
+        .x = 0,
+        .y = 0,
+        .w = width,
+        .h = height,
+    };
+    const SDL_Rect dst = {
+        .x = 0,
+        .y = y,
+        .w = width,
+        .h = height,
+    };
+    sdl_check_code(SDL_RenderCopy(renderer, texture, &src, &dst));
+    if (!cached) {
+        SDL_DestroyTexture(texture);
+    }
+}
+
+// Bring the layer up to date with the editor and copy it to the window
+void render_text_layer(SDL_Renderer *renderer, Font *font, Text_Layer *layer, int width, int height)
+{
+    TRACE_FUNCTION();
+    if (layer->texture == NULL || layer->width != width || layer->height != height) {
+        if (layer->texture) SDL_DestroyTexture(layer->texture);
+        layer->texture = sdl_check_pointer(SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height));
+        layer->width = width;
+        layer->height = height;
+        layer->valid = false;
+    }
+
+    const size_t visible_rows = (height + layout.line_height - 1) / layout.line_height;
+    const size_t visible_cols = (width + layout.advance - 1) / layout.advance;
+    const bool full = !layer->valid
+        || layer->scroll_row != editor.scroll_row
+        || layer->scroll_col != editor.scroll_col
+        || layer->zoom_factor != layout.zoom_factor;
+
+    // Rows to repaint, counted from the top of the window
+    size_t begin = 0;
+    size_t end = visible_rows;
+    if (!full) {
+        const size_t top = editor.scroll_row;
+        begin = editor.dirty_begin > top ? editor.dirty_begin - top : 0;
+        end = editor.dirty_end > top ? editor.dirty_end - top : 0;
+        if (layer->retry_begin < layer->retry_end) {
+            const size_t retry_begin = layer->retry_begin > top ? layer->retry_begin - top : 0;
+            const size_t retry_end = layer->retry_end > top ? layer->retry_end - top : 0;
+            if (begin >= end || retry_begin < begin) begin = retry_begin;
+            if (retry_end > end) end = retry_end;
+        }
+        if (end > visible_rows) end = visible_rows;
+    }
+
+    sdl_check_code(SDL_SetRenderTarget(renderer, layer->texture));
+    sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(BACKGROUND_COLOR)));
+    if (full) {
+        sdl_check_code(SDL_RenderClear(renderer));
+    } else if (begin < end) {
+        const SDL_Rect rows = {
+            .x = 0,
+            .y = begin * layout.line_height,
+            .w = width,
+            .h = (end - begin) * layout.line_height,
+        };
+        sdl_check_code(SDL_RenderFillRect(renderer, &rows));
+    }
+
+    layer->retry_begin = 0;
+    layer->retry_end = 0;
+    for (size_t i = begin; i < end && editor.scroll_row + i < editor_rows(&editor); ++i) {
+        const size_t row = editor.scroll_row + i;
+        const size_t missing = font->missing;
+        render_cached_line(renderer, font, layer, row, visible_cols, i * layout.line_height, 0xffffffff);
+        if (font->missing > missing) {
+            if (layer->retry_begin == layer->retry_end) layer->retry_begin = row;
+            layer->retry_end = row + 1;
+        }
+    }
+    if (begin < end) render_stats.rows_painted += end - begin;
+
+    sdl_check_code(SDL_SetRenderTarget(renderer, NULL));
+    sdl_check_code(SDL_RenderCopy(renderer, layer->texture, NULL, NULL));
+
+    layer->scroll_row = editor.scroll_row;
+    layer->scroll_col = editor.scroll_col;
+    layer->zoom_factor = layout.zoom_factor;
+    layer->valid = true;
+}
+
+// Bar along the bottom of the window while a file is loading or saving
+void render_progress(SDL_Renderer *renderer, Font *font, const char *label, float progress, int window_width, int window_height)
+{
+    const int height = layout.line_height;
+    const SDL_Rect strip = { .x = 0, .y = window_height - height, .w = window_width, .h = height };
+    const SDL_Rect bar = { .x = 0, .y = strip.y, .w = (int) (window_width * progress), .h = height };
+    sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(0x202020ff)));
+    sdl_check_code(SDL_RenderFillRect(renderer, &strip));
+    sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(0x3f6f9fff)));
+    sdl_check_code(SDL_RenderFillRect(renderer, &bar));
+
+    char text[64];
+    const int n = snprintf(text, sizeof(text), "%s %d%%", label, (int) (progress * 100.0f));
+    render_text_sized(font, text, n, 0, strip.y, 0xffffffff);
+    render_flush(renderer, font);
 }
 
 // @TODO: Blinking cursor (23-07-2022)
 // @TODO: Multiple lines
-// @TODO: Save/Load file
-// @TODO: Support for extended ASCII (2^8) (04-08-2022)
 // Read this related post: https://stackoverflow.com/a/41198513/553803
 
-int main(int argc, char *argv[])
+double frame_total(Frame_Times times)
+{
+    return times.events + times.layout + times.render + times.present;
+}
+
+void hud_record(Frame_Times times)
+{
+    hud.frames[hud.count % HUD_FRAMES] = times;
+    hud.count += 1;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+    const double x = *(const double *) a;
+    const double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+// Percentile `p` (0..1) of the recorded frame times
+double hud_percentile(double p)
+{
+    const size_t n = hud.count < HUD_FRAMES ? hud.count : HUD_FRAMES;
+    if (n == 0) {
+        return 0.0;
+    }
+
+    double totals[HUD_FRAMES];
+    for (size_t i = 0; i < n; ++i) {
+        totals[i] = frame_total(hud.frames[i]);
+    }
+    qsort(totals, n, sizeof(totals[0]), compare_doubles);
+    return totals[(size_t) (p * (n - 1) + 0.5)];
+}
+
+// Timings of the last frame, p50/p99 and a bar per recent frame split by
+// phase, in the top right corner
+void render_hud(SDL_Renderer *renderer, Font *font, int width)
+{
+    const Frame_Times last = hud.count > 0 ? hud.frames[(hud.count - 1) % HUD_FRAMES] : (Frame_Times) {0};
+    char lines[5][32];
+    snprintf(lines[0], sizeof(lines[0]), "frame %6.2f ms", frame_total(last) * 1e3);
+    snprintf(lines[1], sizeof(lines[1]), "ev %5.2f lay %5.2f", last.events * 1e3, last.layout * 1e3);
+    snprintf(lines[2], sizeof(lines[2]), "ren %5.2f pre %5.2f", last.render * 1e3, last.present * 1e3);
+    snprintf(lines[3], sizeof(lines[3]), "p50 %5.2f p99 %5.2f", hud_percentile(0.50) * 1e3, hud_percentile(0.99) * 1e3);
+    snprintf(lines[4], sizeof(lines[4]), "input %u ms", hud.input_latency_ms);
+
+    const int cell_width = layout.advance;
+    const int cell_height = layout.line_height;
+    const int text_cols = 19;
+    const int graph_height = 3 * cell_height;
+    const SDL_Rect panel = {
+        .x = width - text_cols * cell_width,
+        .y = 0,
+        .w = text_cols * cell_width,
+        .h = 5 * cell_height + graph_height,
+    };
+    sdl_check_code(SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND));
+    sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(0x000000c0)));
+    sdl_check_code(SDL_RenderFillRect(renderer, &panel));
+
+    for (size_t i = 0; i < 5; ++i) {
+        render_text_sized(font, lines[i], strlen(lines[i]), panel.x, panel.y + i * cell_height, 0xffffffff);
+    }
+    render_flush(renderer, font);
+
+    // Stacked bars, oldest on the left; the full height is one 60 Hz frame
+    const Uint32 colors[4] = { 0x9f6f3fff, 0x3f9f6fff, 0x3f6f9fff, 0x9f3f6fff };
+    SDL_Rect bars[4][HUD_FRAMES];
+    const size_t n = hud.count < HUD_FRAMES ? hud.count : HUD_FRAMES;
+    const float bar_width = (float) panel.w / HUD_FRAMES;
+    const int bottom = panel.y + panel.h;
+    for (size_t i = 0; i < n; ++i) {
+        const Frame_Times times = hud.frames[(hud.count - n + i) % HUD_FRAMES];
+        const double phases[4] = { times.events, times.layout, times.render, times.present };
+        int y = bottom;
+        for (size_t phase = 0; phase < 4; ++phase) {
+            const int h = (int) ceil(phases[phase] / HUD_BUDGET_SECS * graph_height);
+            bars[phase][i] = (SDL_Rect) {
+                .x = panel.x + (int) (i * bar_width),
+                .y = y - h,
+                .w = bar_width < 1.0f ? 1 : (int) bar_width,
+                .h = h,
+            };
+            y -= h;
+        }
+    }
+    for (size_t phase = 0; phase < 4; ++phase) {
+        sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(colors[phase])));
+        sdl_check_code(SDL_RenderFillRects(renderer, bars[phase], n));
+    }
+    sdl_check_code(SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE));
+}
+
+// Draw the text layer, the cursor and the progress bar
+void render_frame(SDL_Renderer *renderer, Font *font, Text_Layer *layer, int width, int height)
 {
-    (void) argc;
-    (void) argv[0];
+    TRACE_FUNCTION();
+    font->missing = 0;
+    if (font->truetype) {
+        glyph_atlas_begin_frame(&font->atlas);
+    }
+
+    // Only the rows that changed are drawn into the layer; the cursor
+    // and the progress bar go on top of it every frame
+    render_text_layer(renderer, font, layer, width, height);
+    editor_mark_clean(&editor);
+
+    // and then... render the cursor
+    render_cursor(renderer, font, 0xffffffff);
+
+    if (editor_saving(&editor)) {
+        const Save_Stats stats = editor_save_stats(&editor);
+        const float progress = stats.bytes_total ? (float) stats.bytes_written / stats.bytes_total : 1.0f;
+        render_progress(renderer, font, "Saving", progress, width, height);
+    } else if (editor_loading(&editor)) {
+        render_progress(renderer, font, "Loading", editor_load_progress(&editor), width, height);
+    }
 
-    sdl_check_code(SDL_Init(SDL_INIT_VIDEO));
-    SDL_Window *window =
-        sdl_check_pointer(SDL_CreateWindow("Rogueban", 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE));
+    if (hud.visible) {
+        render_hud(renderer, font, width);
+    }
 
-    SDL_Renderer *renderer =
-        sdl_check_pointer(SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED));
+    // Glyphs that are not baked yet get drawn on a later frame, repainting
+    // the rows that lack them
+    if (font->missing > 0) {
+        editor.dirty = true;
+    }
+}
+
+void print_stats(const Text_Layer *layer, double elapsed_secs)
+{
+    if (render_stats.frames > 0) {
+        printf("%zu frames: %.3f ms, %.1f glyphs and %.1f glyph draw calls per frame\n",
+               render_stats.frames, render_stats.frame_secs * 1e3 / render_stats.frames,
+               (double) render_stats.glyphs / render_stats.frames,
+               (double) render_stats.draw_calls / render_stats.frames);
+        printf("%.1f rows repainted per frame\n", (double) render_stats.rows_painted / render_stats.frames);
+        printf("%zu wakeups in %.1f s, input to present %.1f ms average, %u ms max\n",
+               render_stats.wakeups, elapsed_secs,
+               render_stats.input_frames ? (double) render_stats.input_latency_ms / render_stats.input_frames : 0.0,
+               render_stats.max_input_latency_ms);
+    }
 
-    Font font = font_load_from_file(FONT, renderer, 0x0);
+    const Line_Cache_Stats cache_stats = layer->lines.stats;
+    if (cache_stats.hits + cache_stats.misses > 0) {
+        printf("line cache: %.1f%% hits, %zu evictions, %zu replaced, %zu lines in %.1f MiB of textures\n",
+               100.0 * cache_stats.hits / (cache_stats.hits + cache_stats.misses),
+               cache_stats.evictions, cache_stats.replaced, cache_stats.entries, cache_stats.bytes / (1024.0 * 1024.0));
+    }
+}
+
+// SDL_WaitEventTimeout that also hands out the replayed events when they
+// are due. The end of the replay quits.
+bool wait_event(SDL_Event *event, int timeout)
+{
+    if (replay.data == NULL) {
+        return SDL_WaitEventTimeout(event, timeout);
+    }
+
+    if (SDL_PollEvent(event)) {
+        return true;
+    }
+    if (replay_done(&replay)) {
+        *event = (SDL_Event) {.type = SDL_QUIT};
+        return true;
+    }
+    if (replay_realtime) {
+        const Uint32 due = replay_next_ticks(&replay);
+        const Uint32 now = SDL_GetTicks() - replay_start;
+        if (due > now) {
+            const int wait = timeout >= 0 && (Uint32) timeout < due - now ? timeout : (int) (due - now);
+            if (SDL_WaitEventTimeout(event, wait)) {
+                return true;
+            }
+            if (SDL_GetTicks() - replay_start < due) {
+                return false;
+            }
+        }
+    }
+    return replay_next(&replay, event);
+}
+
+// SDL_PollEvent for the rest of a frame's events. A fast replay gets a
+// frame per replayed event, a realtime one takes every event that is due.
+bool poll_event(SDL_Event *event)
+{
+    if (SDL_PollEvent(event)) {
+        return true;
+    }
+    if (replay.data && replay_realtime && !replay_done(&replay) &&
+        replay_next_ticks(&replay) <= SDL_GetTicks() - replay_start) {
+        return replay_next(&replay, event);
+    }
+    return false;
+}
+
+void wait_for_load(void)
+{
+    while (editor_loading(&editor)) {
+        editor_poll_load(&editor);
+        SDL_Delay(1);
+    }
+    editor_poll_load(&editor);
+}
+
+void run_window(SDL_Renderer *renderer, Font *font, Text_Layer *text_layer, const char *save_path)
+{
     bool lctrl = false;
     bool quit = false;
-
-    // Start with some string
-    char* title = "ted v0.1";
-    editor_insert_text_before_cursor(&editor, title);
-    editor_insert_new_line(&editor);
+    // Scroll to the cursor on the next frame, after it moved or text changed
+    bool follow_cursor = true;
+    size_t page_rows = 1;
 
     while (!quit) {
+        // Sleep until there is input. While a file loads or saves, or
+        // glyphs are missing, wake up every frame anyway to move the
+        // progress bar. Glyphs left to the next frame are drawn right away,
+        // and glyphs from the baker as soon as it posts their event.
+        const bool busy = editor_loading(&editor) || editor_saving(&editor);
+        int timeout = busy || font->missing > 0 ? BUSY_FRAME_MS : -1;
+        if (font->missing > 0 && font->truetype && font->atlas.frame_deferred) {
+            timeout = 0;
+        }
         SDL_Event event = {0};
-        while (SDL_PollEvent(&event)) {
+        bool have_event = wait_event(&event, timeout);
+        const Uint64 wake = SDL_GetPerformanceCounter();
+        bool had_input = false;
+        Uint32 input_ticks = 0;
+        render_stats.wakeups += 1;
+
+        while (have_event) {
+            TRACE_ZONE("event");
+            recorder_record(&recorder, &event);
+            if ((event.type == SDL_KEYDOWN || event.type == SDL_TEXTINPUT) && !had_input) {
+                had_input = true;
+                input_ticks = event.key.timestamp;
+            }
+
             if (event.type == SDL_QUIT) {
                 quit = true;
+            } else if (event.type == SDL_WINDOWEVENT) {
+                editor.dirty = true;
+            } else if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET) {
+                // The layer's contents and the cached lines are gone
+                text_layer->valid = false;
+                line_cache_clear(&text_layer->lines);
+                editor.dirty = true;
             } else if (event.type == SDL_KEYUP) {
                 switch (event.key.keysym.sym) {
                 case SDLK_LCTRL: {
@@ -202,19 +805,32 @@ int main(int argc, char *argv[])
                     break;
                 }
                 }
+            } else if (event.type == SDL_MOUSEWHEEL) {
+                editor_scroll_by(&editor, -event.wheel.y * 3);
             } else if (event.type == SDL_KEYDOWN ){
+                follow_cursor = true;
+                editor.dirty = true;
                 switch (event.key.keysym.sym) {
                 case SDLK_PLUS: {
-                    if (lctrl)
+                    if (lctrl) {
                         zoom_factor += 0.25;
+                        layout_update(font);
+                    }
                     break;
                 }
                 case SDLK_MINUS: {
                     if (lctrl) {
-                        if (zoom_factor >= 0.75)
+                        if (zoom_factor >= 0.75) {
                             zoom_factor -= 0.25;
+                            layout_update(font);
+                        }
                     } break;
                 }
+                case SDLK_s: {
+                    if (lctrl && !editor_save(&editor, save_path))
+                        fprintf(stderr, "ERROR: still saving %s\n", save_path);
+                    break;
+                }
                 case SDLK_RETURN: {
                     editor_insert_new_line(&editor);
                     break;
@@ -228,28 +844,37 @@ int main(int argc, char *argv[])
                     break;
                 }
                 case SDLK_UP: {
-                    if (editor.cursor_row > 0)
-                        editor.cursor_row -= 1;
+                    editor_move_rows(&editor, -1);
                     break;
                 }
                 case SDLK_DOWN: {
-                    editor.cursor_row += 1;
+                    editor_move_rows(&editor, 1);
+                    break;
+                }
+                case SDLK_PAGEUP: {
+                    editor_move_rows(&editor, -(long) page_rows);
+                    break;
+                }
+                case SDLK_PAGEDOWN: {
+                    editor_move_rows(&editor, (long) page_rows);
                     break;
                 }
                 case SDLK_LEFT: {
-                    if (editor.cursor_col > 0) {
-                        editor.cursor_col -= 1;
-                    }
+                    editor_move_left(&editor);
                     break;
                 }
                 case SDLK_RIGHT: {
-                    editor.cursor_col += 1;
+                    editor_move_right(&editor);
                     break;
                 }
                 case SDLK_LCTRL: {
                     lctrl = true;
                     break;
                 }
+                case SDLK_F1: {
+                    hud.visible = !hud.visible;
+                    break;
+                }
                 case SDLK_ESCAPE: {
                     quit = true;
                     break;
@@ -259,29 +884,242 @@ int main(int argc, char *argv[])
             }
             else if (event.type == SDL_TEXTINPUT && !lctrl) {
                 editor_insert_text_before_cursor(&editor, event.text.text);
+                follow_cursor = true;
             }
+            have_event = poll_event(&event);
         }
-        // Render background color
-        sdl_check_code(SDL_SetRenderDrawColor(renderer, UNPACK_RGBA(BACKGROUND_COLOR)));
-        sdl_check_code(SDL_RenderClear(renderer));
+        const Uint64 events_done = SDL_GetPerformanceCounter();
+
+        editor_poll_load(&editor);
+        Save_Stats save_stats = {0};
+        if (editor_poll_save(&editor, &save_stats) && save_stats.ok) {
+            printf("Saved %s: %zu bytes in %.3f s (%.1f MB/s), stalled %.3f ms\n",
+                   save_path, save_stats.bytes_written, save_stats.write_secs,
+                   save_stats.bytes_per_sec / 1e6, save_stats.stall_secs * 1e3);
+        }
+        // One more frame to take down the progress bar
+        if (busy && !editor_loading(&editor) && !editor_saving(&editor)) {
+            editor.dirty = true;
+        }
+        if (quit || !(editor.dirty || busy)) {
+            continue;
+        }
+
+        int window_width = 0;
+        int window_height = 0;
+        SDL_GetRendererOutputSize(renderer, &window_width, &window_height);
+
+        page_rows = window_height / layout.line_height;
+        if (follow_cursor) {
+            editor_scroll_to_cursor(&editor, page_rows, window_width / layout.advance);
+            follow_cursor = false;
+        }
+
+        const Uint64 layout_done = SDL_GetPerformanceCounter();
+
+        render_frame(renderer, font, text_layer, window_width, window_height);
+        const Uint64 render_done = SDL_GetPerformanceCounter();
+
+        {
+            TRACE_ZONE("present");
+            SDL_RenderPresent(renderer);
+        }
+        const Uint64 present_done = SDL_GetPerformanceCounter();
 
-        // render multiple lines
-        for (size_t row = 0; row < editor.size; ++row) {
-            Line *line = editor.lines + row;
-            render_text_sized(renderer, &font, line->chars, line->size,
-                              vec2f(0, row * FONT_CHAR_HEIGHT * FONT_SCALE * zoom_factor),
-                              0xffffffff);
+        hud_record((Frame_Times) {
+            .events = secs_between(wake, events_done),
+            .layout = secs_between(events_done, layout_done),
+            .render = secs_between(layout_done, render_done),
+            .present = secs_between(render_done, present_done),
+        });
+        render_stats.frames += 1;
+        render_stats.frame_secs += secs_between(wake, present_done);
+        if (had_input) {
+            const Uint32 latency = SDL_GetTicks() - input_ticks;
+            hud.input_latency_ms = latency;
+            render_stats.input_frames += 1;
+            render_stats.input_latency_ms += latency;
+            if (latency > render_stats.max_input_latency_ms) render_stats.max_input_latency_ms = latency;
         }
-        // and then... render the cursor
-        render_cursor(renderer, &font, 0xffffffff);
+    }
+}
+
+// Page down through the document one frame at a time, without a window
+void run_headless(SDL_Renderer *renderer, Font *font, Text_Layer *text_layer, size_t frames)
+{
+    // Benchmarks and golden images need the whole document
+    wait_for_load();
+
+    int width = 0;
+    int height = 0;
+    sdl_check_code(SDL_GetRendererOutputSize(renderer, &width, &height));
+    const size_t page_rows = height / layout.line_height;
+
+    for (size_t frame = 0; frame < frames; ++frame) {
+        const Uint64 frame_start = SDL_GetPerformanceCounter();
+        if (frame > 0 && editor.cursor_row + page_rows < editor_rows(&editor)) {
+            editor_move_rows(&editor, (long) page_rows);
+        }
+        editor_scroll_to_cursor(&editor, page_rows, width / layout.advance);
+        const Uint64 layout_done = SDL_GetPerformanceCounter();
+
+        render_frame(renderer, font, text_layer, width, height);
+        const Uint64 render_done = SDL_GetPerformanceCounter();
 
         SDL_RenderPresent(renderer);
-        SDL_Delay(30);
+        const Uint64 present_done = SDL_GetPerformanceCounter();
+
+        hud_record((Frame_Times) {
+            .layout = secs_between(frame_start, layout_done),
+            .render = secs_between(layout_done, render_done),
+            .present = secs_between(render_done, present_done),
+        });
+        render_stats.frames += 1;
+        render_stats.frame_secs += secs_between(frame_start, present_done);
+    }
+}
+
+void usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [--headless] [--frames N] [--dump FILE.bmp] [--hud] [--ttf]\n", program);
+    fprintf(stderr, "       [--record FILE] [--replay FILE [--realtime]] [file]\n");
+    fprintf(stderr, "    --headless        render offscreen with the software renderer\n");
+    fprintf(stderr, "    --frames N        frames to render when headless (default %d)\n", HEADLESS_DEFAULT_FRAMES);
+    fprintf(stderr, "    --dump FILE.bmp   save the last headless frame\n");
+    fprintf(stderr, "    --hud             start with the frame time overlay (F1) shown\n");
+    fprintf(stderr, "    --ttf             draw with %s instead of the bitmap font\n", TRUETYPE_FONT);
+    fprintf(stderr, "    --record FILE     write the keyboard and mouse wheel input to FILE\n");
+    fprintf(stderr, "    --replay FILE     play back a recording, drawing a frame per event, then quit\n");
+    fprintf(stderr, "    --realtime        play it back at the speed it was recorded\n");
+}
+
+int main(int argc, char *argv[])
+{
+    TRACE_THREAD_NAME("main");
+    const char *file_path = NULL;
+    bool headless = false;
+    size_t headless_frames = HEADLESS_DEFAULT_FRAMES;
+    const char *dump_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    bool truetype = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headless_frames = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            dump_path = argv[++i];
+        } else if (strcmp(argv[i], "--hud") == 0) {
+            hud.visible = true;
+        } else if (strcmp(argv[i], "--ttf") == 0) {
+            truetype = true;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i];
+        } else if (strcmp(argv[i], "--realtime") == 0) {
+            replay_realtime = true;
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            exit(1);
+        } else {
+            file_path = argv[i];
+        }
+    }
+    const char *save_path = file_path ? file_path : "untitled.txt";
+
+    if (replay_path && !replay_load(&replay, replay_path)) {
+        exit(1);
+    }
+
+    SDL_Window *window = NULL;
+    SDL_Surface *surface = NULL;
+    SDL_Renderer *renderer = NULL;
+    if (headless) {
+        // No display needed: the software renderer draws into a surface
+        sdl_check_code(SDL_Init(replay_path ? SDL_INIT_EVENTS : 0));
+        surface = sdl_check_pointer(SDL_CreateRGBSurfaceWithFormat(0, WINDOW_WIDTH, WINDOW_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888));
+        renderer = sdl_check_pointer(SDL_CreateSoftwareRenderer(surface));
+    } else {
+        sdl_check_code(SDL_Init(SDL_INIT_VIDEO));
+        window = sdl_check_pointer(SDL_CreateWindow("Rogueban", 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_RESIZABLE));
+        renderer = sdl_check_pointer(SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE));
+    }
+
+    Font font = truetype ? font_load_truetype(TRUETYPE_FONT, renderer) : font_load_from_file(FONT, renderer, 0x0);
+    layout_update(&font);
+    if (font.truetype && (headless || replay_path)) {
+        // Golden images and replays have to come out the same every run,
+        // so no glyph is left for a later frame
+        font.atlas.deterministic = true;
+        glyph_atlas_wait(&font.atlas);
+    }
+    Text_Layer text_layer = {0};
+    line_cache_init(&text_layer.lines, LINE_CACHE_MAX_ENTRIES, LINE_CACHE_MAX_BYTES);
+
+    if (file_path) {
+        if (!editor_open_file(&editor, file_path)) {
+            exit(1);
+        }
+    } else {
+        // Start with some string
+        char* title = "ted v0.1";
+        editor_insert_text_before_cursor(&editor, title);
+        editor_insert_new_line(&editor);
     }
 
-    SDL_DestroyTexture(font.spritesheet);
+    if (record_path && !recorder_open(&recorder, record_path)) {
+        exit(1);
+    }
+    if (replay_path) {
+        // The recorded keys have to land on the same rows every time
+        wait_for_load();
+        replay_start = SDL_GetTicks();
+    }
+
+    const Uint64 start = SDL_GetPerformanceCounter();
+    if (headless && !replay_path) {
+        run_headless(renderer, &font, &text_layer, headless_frames);
+    } else {
+        run_window(renderer, &font, &text_layer, save_path);
+    }
+    if (headless && dump_path && SDL_SaveBMP(surface, dump_path) < 0) {
+        fprintf(stderr, "ERROR: could not save %s: %s\n", dump_path, SDL_GetError());
+    }
+    print_stats(&text_layer, (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency());
+    if (font.truetype) {
+        printf("glyph atlas: %zu glyphs baked at %zu sizes on %zu pages, %zu evictions, %zu deferred\n",
+               font.atlas.stats.baked, font.atlas.size_count, font.atlas.page_count,
+               font.atlas.stats.evictions, font.atlas.stats.deferred);
+        printf("glyph atlas: %zu glyphs baked ahead, %zu sizes read from the cache\n",
+               font.atlas.stats.prebaked, font.atlas.stats.cached_sizes);
+    }
+    if (replay_path) {
+        printf("replayed %zu events from %s\n", replay.events, replay_path);
+        replay_free(&replay);
+    }
+    if (record_path) {
+        printf("recorded %zu events to %s\n", recorder.events, record_path);
+        recorder_close(&recorder);
+    }
+
+    editor_free(&editor);
+    glyph_atlas_free(&font.atlas);
+#ifdef TED_TRACE
+    // Every thread that records zones has been joined by now
+    const char *trace_path = getenv("TED_TRACE_FILE");
+    trace_dump(trace_path ? trace_path : "ted.trace.json");
+#endif
+    line_cache_free(&text_layer.lines);
+    if (text_layer.texture) SDL_DestroyTexture(text_layer.texture);
+    free(font.vertices);
+    free(font.indices);
+    free(font.pages);
+    if (font.spritesheet) SDL_DestroyTexture(font.spritesheet);
     SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    if (window) SDL_DestroyWindow(window);
+    if (surface) SDL_FreeSurface(surface);
     SDL_Quit();
     return(0);
 }
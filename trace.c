@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include "./trace.h"
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+} Trace_Event;
+
+// Zones of one thread. Buffers are never freed, so the zones of threads
+// that already exited still make it into the dump.
+typedef struct Trace_Buffer Trace_Buffer;
+struct Trace_Buffer {
+    Trace_Event *events;
+    size_t count;
+    size_t capacity;
+    size_t tid;
+    const char *thread_name;
+    Trace_Buffer *next;
+};
+
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static Trace_Buffer *trace_buffers = NULL;
+static size_t trace_thread_count = 0;
+static _Thread_local Trace_Buffer *trace_buffer = NULL;
+
+static uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static Trace_Buffer *trace_thread_buffer(void)
+{
+    if (trace_buffer == NULL) {
+        trace_buffer = calloc(1, sizeof(*trace_buffer));
+        assert(trace_buffer != NULL);
+
+        pthread_mutex_lock(&trace_mutex);
+        trace_buffer->tid = ++trace_thread_count;
+        trace_buffer->next = trace_buffers;
+        trace_buffers = trace_buffer;
+        pthread_mutex_unlock(&trace_mutex);
+    }
+    return trace_buffer;
+}
+
+Trace_Zone trace_zone_begin(const char *name)
+{
+    return (Trace_Zone) {
+        .name = name,
+        .start_ns = trace_now_ns(),
+    };
+}
+
+void trace_zone_end(Trace_Zone *zone)
+{
+    const uint64_t end_ns = trace_now_ns();
+    Trace_Buffer *buffer = trace_thread_buffer();
+    if (buffer->count >= buffer->capacity) {
+        buffer->capacity = buffer->capacity == 0 ? 1024 : buffer->capacity * 2;
+        buffer->events = realloc(buffer->events, buffer->capacity * sizeof(buffer->events[0]));
+        assert(buffer->events != NULL);
+    }
+    buffer->events[buffer->count++] = (Trace_Event) {
+        .name = zone->name,
+        .start_ns = zone->start_ns,
+        .duration_ns = end_ns - zone->start_ns,
+    };
+}
+
+// Label the calling thread in the trace
+void trace_thread_name(const char *name)
+{
+    trace_thread_buffer()->thread_name = name;
+}
+
+// Write every recorded zone as complete ("X") events. Call it once the
+// other threads are done.
+void trace_dump(const char *file_path)
+{
+    FILE *f = fopen(file_path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", file_path, strerror(errno));
+        return;
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const Trace_Buffer *buffer = trace_buffers; buffer != NULL; buffer = buffer->next) {
+        if (buffer->thread_name) {
+            fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buffer->tid, buffer->thread_name);
+            first = false;
+        }
+        for (size_t i = 0; i < buffer->count; ++i) {
+            const Trace_Event *event = &buffer->events[i];
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n", event->name, buffer->tid,
+                    event->start_ns / 1e3, event->duration_ns / 1e3);
+            first = false;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    pthread_mutex_unlock(&trace_mutex);
+
+    fclose(f);
+}
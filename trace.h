@@ -0,0 +1,44 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+#include <stdlib.h>
+#include <stdint.h>
+
+// Scoped timing zones, dumped as Chrome trace-event JSON that Perfetto
+// and chrome://tracing can open. Zones are only recorded in builds with
+// TED_TRACE defined (./build.sh trace); otherwise the macros expand to
+// nothing.
+//
+//     void editor_delete(Editor *editor)
+//     {
+//         TRACE_FUNCTION();
+//         ...
+//     }
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+} Trace_Zone;
+
+Trace_Zone trace_zone_begin(const char *name);
+void trace_zone_end(Trace_Zone *zone);
+void trace_thread_name(const char *name);
+void trace_dump(const char *file_path);
+
+#ifdef TED_TRACE
+#ifndef __GNUC__
+#error "TED_TRACE needs the cleanup attribute of GCC or Clang"
+#endif
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// `name` must outlive the trace, e.g. a string literal
+#define TRACE_ZONE(name) \
+    Trace_Zone TRACE_CONCAT(trace_zone_, __LINE__) __attribute__((cleanup(trace_zone_end))) = trace_zone_begin(name)
+#define TRACE_FUNCTION() TRACE_ZONE(__func__)
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+#else
+#define TRACE_ZONE(name) ((void) 0)
+#define TRACE_FUNCTION() ((void) 0)
+#define TRACE_THREAD_NAME(name) ((void) 0)
+#endif
+
+#endif // TRACE_H_
@@ -0,0 +1,519 @@
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include "./ttf.h"
+
+#define TTF_MAX_COMPOSITE_DEPTH 8
+
+static int u8_at(const Ttf_Font *font, size_t pos)
+{
+    return pos < font->size ? font->data[pos] : 0;
+}
+
+static int u16_at(const Ttf_Font *font, size_t pos)
+{
+    return u8_at(font, pos) << 8 | u8_at(font, pos + 1);
+}
+
+static int i16_at(const Ttf_Font *font, size_t pos)
+{
+    return (int16_t) u16_at(font, pos);
+}
+
+static uint32_t u32_at(const Ttf_Font *font, size_t pos)
+{
+    return (uint32_t) u16_at(font, pos) << 16 | u16_at(font, pos + 2);
+}
+
+static size_t find_table(const Ttf_Font *font, const char *tag)
+{
+    const int tables = u16_at(font, 4);
+    for (int i = 0; i < tables; ++i) {
+        const size_t entry = 12 + 16 * i;
+        if (entry + 16 <= font->size && memcmp(font->data + entry, tag, 4) == 0) {
+            const size_t offset = u32_at(font, entry + 8);
+            return offset < font->size ? offset : 0;
+        }
+    }
+    return 0;
+}
+
+bool ttf_init(Ttf_Font *font, const unsigned char *data, size_t size)
+{
+    *font = (Ttf_Font) { .data = data, .size = size };
+    if (size < 12) {
+        return false;
+    }
+
+    const size_t head = find_table(font, "head");
+    const size_t hhea = find_table(font, "hhea");
+    const size_t maxp = find_table(font, "maxp");
+    const size_t cmap = find_table(font, "cmap");
+    font->glyf = find_table(font, "glyf");
+    font->loca = find_table(font, "loca");
+    font->hmtx = find_table(font, "hmtx");
+    if (!head || !hhea || !maxp || !cmap || !font->glyf || !font->loca || !font->hmtx) {
+        return false;
+    }
+
+    font->units_per_em = u16_at(font, head + 18);
+    font->loca_long = i16_at(font, head + 50) != 0;
+    font->glyph_count = u16_at(font, maxp + 4);
+    font->ascent = i16_at(font, hhea + 4);
+    font->descent = i16_at(font, hhea + 6);
+    font->line_gap = i16_at(font, hhea + 8);
+    font->hmetric_count = u16_at(font, hhea + 34);
+
+    // Prefer the full Unicode subtable, then the BMP one
+    const int subtables = u16_at(font, cmap + 2);
+    for (int i = 0; i < subtables; ++i) {
+        const size_t record = cmap + 4 + 8 * i;
+        const int platform = u16_at(font, record);
+        const int encoding = u16_at(font, record + 2);
+        const size_t subtable = cmap + u32_at(font, record + 4);
+        const int format = u16_at(font, subtable);
+        const bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+        if (!unicode || (format != 4 && format != 12)) continue;
+        if (font->cmap == 0 || format == 12) {
+            font->cmap = subtable;
+            font->cmap_format = format;
+        }
+    }
+
+    return font->cmap != 0 && font->units_per_em > 0 && font->ascent > font->descent;
+}
+
+// Glyph for `codepoint`, or 0 (the missing glyph) if the font has none
+int ttf_glyph_index(const Ttf_Font *font, uint32_t codepoint)
+{
+    const size_t cmap = font->cmap;
+    if (font->cmap_format == 4) {
+        if (codepoint > 0xffff) return 0;
+        const int segments = u16_at(font, cmap + 6) / 2;
+        const size_t ends = cmap + 14;
+        const size_t starts = ends + 2 * segments + 2;
+        const size_t deltas = starts + 2 * segments;
+        const size_t range_offsets = deltas + 2 * segments;
+
+        // Segments are sorted by their last codepoint
+        int lo = 0;
+        int hi = segments;
+        while (lo < hi) {
+            const int mid = (lo + hi) / 2;
+            if ((uint32_t) u16_at(font, ends + 2 * mid) < codepoint) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo == segments) return 0;
+
+        const uint32_t start = u16_at(font, starts + 2 * lo);
+        if (codepoint < start) return 0;
+        const int delta = u16_at(font, deltas + 2 * lo);
+        const int range_offset = u16_at(font, range_offsets + 2 * lo);
+        if (range_offset == 0) {
+            return (codepoint + delta) & 0xffff;
+        }
+        const int glyph = u16_at(font, range_offsets + 2 * lo + range_offset + 2 * (codepoint - start));
+        return glyph ? (glyph + delta) & 0xffff : 0;
+    } else if (font->cmap_format == 12) {
+        const uint32_t groups = u32_at(font, cmap + 12);
+        uint32_t lo = 0;
+        uint32_t hi = groups;
+        while (lo < hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            const size_t group = cmap + 16 + 12 * (size_t) mid;
+            const uint32_t first = u32_at(font, group);
+            const uint32_t last = u32_at(font, group + 4);
+            if (codepoint < first) {
+                hi = mid;
+            } else if (codepoint > last) {
+                lo = mid + 1;
+            } else {
+                return u32_at(font, group + 8) + (codepoint - first);
+            }
+        }
+    }
+    return 0;
+}
+
+// Scale from font units to pixels for text `pixels` high from the
+// lowest descender to the highest ascender
+float ttf_scale_for_height(const Ttf_Font *font, float pixels)
+{
+    return pixels / (font->ascent - font->descent);
+}
+
+void ttf_glyph_metrics(const Ttf_Font *font, int glyph, int *advance, int *left_bearing)
+{
+    if (font->hmetric_count == 0) {
+        *advance = 0;
+        *left_bearing = 0;
+    } else if (glyph < font->hmetric_count) {
+        *advance = u16_at(font, font->hmtx + 4 * glyph);
+        *left_bearing = i16_at(font, font->hmtx + 4 * glyph + 2);
+    } else {
+        // Monospaced tails share the last advance
+        *advance = u16_at(font, font->hmtx + 4 * (font->hmetric_count - 1));
+        *left_bearing = i16_at(font, font->hmtx + 4 * font->hmetric_count + 2 * (glyph - font->hmetric_count));
+    }
+}
+
+// Offset of the glyph's outline in the glyf table, or 0 if it has none
+static size_t glyph_offset(const Ttf_Font *font, int glyph)
+{
+    if (glyph < 0 || glyph >= font->glyph_count) return 0;
+
+    size_t begin, end;
+    if (font->loca_long) {
+        begin = u32_at(font, font->loca + 4 * glyph);
+        end = u32_at(font, font->loca + 4 * glyph + 4);
+    } else {
+        begin = 2 * (size_t) u16_at(font, font->loca + 2 * glyph);
+        end = 2 * (size_t) u16_at(font, font->loca + 2 * glyph + 2);
+    }
+    if (begin >= end || font->glyf + end > font->size) return 0;
+    return font->glyf + begin;
+}
+
+// Pixel box of the glyph relative to the pen on the baseline, y down.
+// Returns false if the glyph draws nothing.
+bool ttf_glyph_box(const Ttf_Font *font, int glyph, float scale, int *x0, int *y0, int *x1, int *y1)
+{
+    const size_t g = glyph_offset(font, glyph);
+    if (g == 0) {
+        *x0 = *y0 = *x1 = *y1 = 0;
+        return false;
+    }
+
+    *x0 = (int) floorf(i16_at(font, g + 2) * scale);
+    *y0 = (int) floorf(-i16_at(font, g + 8) * scale);
+    *x1 = (int) ceilf(i16_at(font, g + 6) * scale);
+    *y1 = (int) ceilf(-i16_at(font, g + 4) * scale);
+    return *x1 > *x0 && *y1 > *y0;
+}
+
+typedef struct {
+    float x;
+    float y;
+} Ttf_Point;
+
+// Signed area coverage accumulated per pixel: every edge adds the area
+// it covers to the right of itself, and a running sum along each row
+// turns that into the coverage of the pixel (non-zero winding).
+typedef struct {
+    float *area;
+    int width;
+    int height;
+} Raster;
+
+// Font units to pixels: x' = xx * x + xy * y + dx, y' = yx * x + yy * y + dy
+typedef struct {
+    float xx, xy, yx, yy, dx, dy;
+} Transform;
+
+static Ttf_Point transform_apply(Transform t, float x, float y)
+{
+    return (Ttf_Point) { t.xx * x + t.xy * y + t.dx, t.yx * x + t.yy * y + t.dy };
+}
+
+static float clampf(float x, float lo, float hi)
+{
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+static void raster_line(Raster *r, Ttf_Point p0, Ttf_Point p1)
+{
+    p0.x = clampf(p0.x, 0, r->width);
+    p1.x = clampf(p1.x, 0, r->width);
+    p0.y = clampf(p0.y, 0, r->height);
+    p1.y = clampf(p1.y, 0, r->height);
+    if (p0.y == p1.y) {
+        return;
+    }
+
+    float dir = 1.0f;
+    if (p0.y > p1.y) {
+        const Ttf_Point t = p0;
+        p0 = p1;
+        p1 = t;
+        dir = -1.0f;
+    }
+
+    const float dxdy = (p1.x - p0.x) / (p1.y - p0.y);
+    float x = p0.x;
+    const int row_end = (int) ceilf(p1.y) < r->height ? (int) ceilf(p1.y) : r->height;
+    for (int y = (int) p0.y; y < row_end; ++y) {
+        float *row = r->area + (size_t) y * r->width;
+        const float dy = fminf(y + 1.0f, p1.y) - fmaxf((float) y, p0.y);
+        const float x_next = x + dxdy * dy;
+        const float d = dy * dir;
+        const float xa = fminf(x, x_next);
+        const float xb = fmaxf(x, x_next);
+        const float xa_floor = floorf(xa);
+        const int xai = (int) xa_floor;
+        const float xb_ceil = ceilf(xb);
+        const int xbi = (int) xb_ceil;
+
+        if (xbi <= xai + 1) {
+            // The edge stays inside one pixel on this row
+            const float xm = 0.5f * (x + x_next) - xa_floor;
+            row[xai] += d - d * xm;
+            row[xai + 1] += d * xm;
+        } else {
+            const float s = 1.0f / (xb - xa);
+            const float xaf = xa - xa_floor;
+            const float a0 = 0.5f * s * (1.0f - xaf) * (1.0f - xaf);
+            const float xbf = xb - xb_ceil + 1.0f;
+            const float am = 0.5f * s * xbf * xbf;
+            row[xai] += d * a0;
+            if (xbi == xai + 2) {
+                row[xai + 1] += d * (1.0f - a0 - am);
+            } else {
+                const float a1 = s * (1.5f - xaf);
+                row[xai + 1] += d * (a1 - a0);
+                for (int xi = xai + 2; xi < xbi - 1; ++xi) {
+                    row[xi] += d * s;
+                }
+                const float a2 = a1 + (xbi - xai - 3) * s;
+                row[xbi - 1] += d * (1.0f - a2 - am);
+            }
+            row[xbi] += d * am;
+        }
+        x = x_next;
+    }
+}
+
+static void raster_quad(Raster *r, Ttf_Point p0, Ttf_Point c, Ttf_Point p1)
+{
+    // Enough segments to stay within a fraction of a pixel of the curve
+    const float ddx = p0.x - 2.0f * c.x + p1.x;
+    const float ddy = p0.y - 2.0f * c.y + p1.y;
+    const int n = 1 + (int) sqrtf(sqrtf(ddx * ddx + ddy * ddy) * 3.0f);
+
+    Ttf_Point prev = p0;
+    for (int i = 1; i <= n; ++i) {
+        const float t = (float) i / n;
+        const float u = 1.0f - t;
+        const Ttf_Point p = {
+            u * u * p0.x + 2.0f * u * t * c.x + t * t * p1.x,
+            u * u * p0.y + 2.0f * u * t * c.y + t * t * p1.y,
+        };
+        raster_line(r, prev, p);
+        prev = p;
+    }
+}
+
+static Ttf_Point midpoint(Ttf_Point a, Ttf_Point b)
+{
+    return (Ttf_Point) { (a.x + b.x) * 0.5f, (a.y + b.y) * 0.5f };
+}
+
+// One closed contour of on-curve points and quadratic control points.
+// Two control points in a row imply an on-curve point between them.
+static void raster_contour(Raster *r, const Ttf_Point *points, const unsigned char *flags, int count)
+{
+    if (count < 2) return;
+
+    Ttf_Point start;
+    int first, last;
+    if (flags[0] & 1) {
+        start = points[0];
+        first = 1;
+        last = count - 1;
+    } else if (flags[count - 1] & 1) {
+        start = points[count - 1];
+        first = 0;
+        last = count - 2;
+    } else {
+        start = midpoint(points[0], points[count - 1]);
+        first = 0;
+        last = count - 1;
+    }
+
+    Ttf_Point prev = start;
+    Ttf_Point control = {0};
+    bool have_control = false;
+    for (int i = first; i <= last; ++i) {
+        if (flags[i] & 1) {
+            if (have_control) {
+                raster_quad(r, prev, control, points[i]);
+            } else {
+                raster_line(r, prev, points[i]);
+            }
+            prev = points[i];
+            have_control = false;
+        } else {
+            if (have_control) {
+                const Ttf_Point mid = midpoint(control, points[i]);
+                raster_quad(r, prev, control, mid);
+                prev = mid;
+            }
+            control = points[i];
+            have_control = true;
+        }
+    }
+    if (have_control) {
+        raster_quad(r, prev, control, start);
+    } else {
+        raster_line(r, prev, start);
+    }
+}
+
+static void raster_simple_glyph(Raster *r, const Ttf_Font *font, size_t g, int contours, Transform t)
+{
+    const size_t end_points = g + 10;
+    const int count = u16_at(font, end_points + 2 * (contours - 1)) + 1;
+    size_t pos = end_points + 2 * contours;
+    pos += 2 + u16_at(font, pos);
+
+    unsigned char *flags = malloc(count);
+    Ttf_Point *points = malloc(count * sizeof(points[0]));
+    assert(flags != NULL && points != NULL);
+
+    for (int i = 0; i < count;) {
+        const unsigned char flag = u8_at(font, pos++);
+        int repeat = flag & 8 ? u8_at(font, pos++) : 0;
+        flags[i++] = flag;
+        while (repeat-- > 0 && i < count) {
+            flags[i++] = flag;
+        }
+    }
+
+    int x = 0;
+    for (int i = 0; i < count; ++i) {
+        if (flags[i] & 2) {
+            const int dx = u8_at(font, pos++);
+            x += flags[i] & 16 ? dx : -dx;
+        } else if (!(flags[i] & 16)) {
+            x += i16_at(font, pos);
+            pos += 2;
+        }
+        points[i].x = x;
+    }
+    int y = 0;
+    for (int i = 0; i < count; ++i) {
+        if (flags[i] & 4) {
+            const int dy = u8_at(font, pos++);
+            y += flags[i] & 32 ? dy : -dy;
+        } else if (!(flags[i] & 32)) {
+            y += i16_at(font, pos);
+            pos += 2;
+        }
+        points[i] = transform_apply(t, points[i].x, y);
+    }
+
+    int begin = 0;
+    for (int c = 0; c < contours; ++c) {
+        int end = u16_at(font, end_points + 2 * c) + 1;
+        if (end > count) end = count;
+        if (end > begin) {
+            raster_contour(r, points + begin, flags + begin, end - begin);
+            begin = end;
+        }
+    }
+
+    free(points);
+    free(flags);
+}
+
+static void raster_glyph(Raster *r, const Ttf_Font *font, int glyph, Transform t, int depth)
+{
+    const size_t g = glyph_offset(font, glyph);
+    if (g == 0 || depth > TTF_MAX_COMPOSITE_DEPTH) return;
+
+    const int contours = i16_at(font, g);
+    if (contours > 0) {
+        raster_simple_glyph(r, font, g, contours, t);
+        return;
+    }
+    if (contours == 0) return;
+
+    // Composite: other glyphs moved and scaled into place
+    enum {
+        ARG_1_AND_2_ARE_WORDS = 0x1,
+        ARGS_ARE_XY_VALUES = 0x2,
+        WE_HAVE_A_SCALE = 0x8,
+        MORE_COMPONENTS = 0x20,
+        WE_HAVE_AN_X_AND_Y_SCALE = 0x40,
+        WE_HAVE_A_TWO_BY_TWO = 0x80,
+    };
+    size_t pos = g + 10;
+    int flags;
+    do {
+        flags = u16_at(font, pos);
+        const int component = u16_at(font, pos + 2);
+        pos += 4;
+
+        float dx = 0.0f;
+        float dy = 0.0f;
+        if (flags & ARG_1_AND_2_ARE_WORDS) {
+            dx = i16_at(font, pos);
+            dy = i16_at(font, pos + 2);
+            pos += 4;
+        } else {
+            dx = (int8_t) u8_at(font, pos);
+            dy = (int8_t) u8_at(font, pos + 1);
+            pos += 2;
+        }
+        // Components aligned by matching points are placed unmoved
+        if (!(flags & ARGS_ARE_XY_VALUES)) {
+            dx = dy = 0.0f;
+        }
+
+        float xx = 1.0f, xy = 0.0f, yx = 0.0f, yy = 1.0f;
+        if (flags & WE_HAVE_A_SCALE) {
+            xx = yy = i16_at(font, pos) / 16384.0f;
+            pos += 2;
+        } else if (flags & WE_HAVE_AN_X_AND_Y_SCALE) {
+            xx = i16_at(font, pos) / 16384.0f;
+            yy = i16_at(font, pos + 2) / 16384.0f;
+            pos += 4;
+        } else if (flags & WE_HAVE_A_TWO_BY_TWO) {
+            xx = i16_at(font, pos) / 16384.0f;
+            yx = i16_at(font, pos + 2) / 16384.0f;
+            xy = i16_at(font, pos + 4) / 16384.0f;
+            yy = i16_at(font, pos + 6) / 16384.0f;
+            pos += 8;
+        }
+
+        // Apply the component's transform first, then the parent's
+        const Transform c = {
+            .xx = t.xx * xx + t.xy * yx,
+            .xy = t.xx * xy + t.xy * yy,
+            .yx = t.yx * xx + t.yy * yx,
+            .yy = t.yx * xy + t.yy * yy,
+            .dx = t.xx * dx + t.xy * dy + t.dx,
+            .dy = t.yx * dx + t.yy * dy + t.dy,
+        };
+        raster_glyph(r, font, component, c, depth + 1);
+    } while (flags & MORE_COMPONENTS);
+}
+
+// Render the glyph's coverage into a `width` by `height` bitmap whose top
+// left corner is (x0, y0) of ttf_glyph_box at the same scale. The output
+// is cached on disk, so changes to it bump GLYPH_CACHE_VERSION.
+void ttf_render_glyph(const Ttf_Font *font, int glyph, float scale, unsigned char *pixels, int width, int height, int stride)
+{
+    int x0, y0, x1, y1;
+    ttf_glyph_box(font, glyph, scale, &x0, &y0, &x1, &y1);
+
+    // Edges can reach one past the last pixel of a row
+    Raster r = { .width = width, .height = height };
+    r.area = calloc((size_t) width * height + 2, sizeof(r.area[0]));
+    assert(r.area != NULL);
+
+    const Transform t = { .xx = scale, .yy = -scale, .dx = -x0, .dy = -y0 };
+    raster_glyph(&r, font, glyph, t, 0);
+
+    float coverage = 0.0f;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            coverage += r.area[(size_t) y * width + x];
+            const float a = fminf(fabsf(coverage), 1.0f);
+            pixels[(size_t) y * stride + x] = (unsigned char) (a * 255.0f + 0.5f);
+        }
+    }
+    free(r.area);
+}
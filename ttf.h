@@ -0,0 +1,36 @@
+#ifndef TTF_H_
+#define TTF_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Just enough of TrueType to draw text: glyph lookup through the cmap
+// (formats 4 and 12), horizontal metrics, and anti-aliased rendering of
+// simple and composite glyph outlines. Hinting is ignored. The font
+// reads straight from `data`, which has to outlive it.
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t glyf;
+    size_t loca;
+    size_t hmtx;
+    size_t cmap;
+    int cmap_format;
+    int glyph_count;
+    int hmetric_count;
+    int units_per_em;
+    bool loca_long;
+    // In font units, y up from the baseline
+    int ascent;
+    int descent;
+    int line_gap;
+} Ttf_Font;
+
+bool ttf_init(Ttf_Font *font, const unsigned char *data, size_t size);
+int ttf_glyph_index(const Ttf_Font *font, uint32_t codepoint);
+float ttf_scale_for_height(const Ttf_Font *font, float pixels);
+void ttf_glyph_metrics(const Ttf_Font *font, int glyph, int *advance, int *left_bearing);
+bool ttf_glyph_box(const Ttf_Font *font, int glyph, float scale, int *x0, int *y0, int *x1, int *y1);
+void ttf_render_glyph(const Ttf_Font *font, int glyph, float scale, unsigned char *pixels, int width, int height, int stride);
+
+#endif // TTF_H_
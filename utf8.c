@@ -0,0 +1,403 @@
+#include <assert.h>
+#include "./utf8.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define UTF8_X86
+#include <immintrin.h>
+#endif
+
+// Bit i of a mask is set for byte i of a 64 byte block
+typedef uint64_t (*Mask_Func)(const char *block);
+typedef bool (*Valid_Func)(const char *text, size_t size);
+
+static uint64_t continuation_mask_scalar(const char *block)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 64; ++i) {
+        mask |= (uint64_t) UTF8_IS_CONTINUATION(block[i]) << i;
+    }
+    return mask;
+}
+
+static uint64_t high_mask_scalar(const char *block)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 64; ++i) {
+        mask |= (uint64_t) ((unsigned char) block[i] >> 7) << i;
+    }
+    return mask;
+}
+
+#ifdef UTF8_X86
+// Continuation bytes are the signed bytes below -64 (0xc0)
+__attribute__((target("sse2")))
+static uint64_t continuation_mask_sse2(const char *block)
+{
+    const __m128i limit = _mm_set1_epi8(-64);
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (block + i * 16));
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmplt_epi8(v, limit)) << (i * 16);
+    }
+    return mask;
+}
+
+__attribute__((target("sse2")))
+static uint64_t high_mask_sse2(const char *block)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) (block + i * 16));
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(v) << (i * 16);
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t continuation_mask_avx2(const char *block)
+{
+    const __m256i limit = _mm256_set1_epi8(-64);
+    const __m256i a = _mm256_loadu_si256((const __m256i *) block);
+    const __m256i b = _mm256_loadu_si256((const __m256i *) (block + 32));
+    return (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, a)) |
+           (uint64_t) (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(limit, b)) << 32;
+}
+
+__attribute__((target("avx2")))
+static uint64_t high_mask_avx2(const char *block)
+{
+    const __m256i a = _mm256_loadu_si256((const __m256i *) block);
+    const __m256i b = _mm256_loadu_si256((const __m256i *) (block + 32));
+    return (uint64_t) (uint32_t) _mm256_movemask_epi8(a) |
+           (uint64_t) (uint32_t) _mm256_movemask_epi8(b) << 32;
+}
+
+// Keiser and Lemire's validator ("Validating UTF-8 In Less Than One
+// Instruction Per Byte"): three 16 entry lookups on the nibbles of each
+// byte and the one before it flag every error of a 2 byte window, and
+// the 3rd and 4th bytes of long sequences are checked against the leads
+// 2 and 3 bytes back. Bits of the lookup results:
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+#define UTF8_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+#define B(x) ((char) (x))
+
+__attribute__((target("avx2")))
+static __m256i utf8_prev_avx2(__m256i input, __m256i prev_input, int n)
+{
+    const __m256i joined = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch (n) {
+    case 1:  return _mm256_alignr_epi8(input, joined, 15);
+    case 2:  return _mm256_alignr_epi8(input, joined, 14);
+    default: return _mm256_alignr_epi8(input, joined, 13);
+    }
+}
+
+__attribute__((target("avx2")))
+static bool utf8_valid_avx2(const char *text, size_t size)
+{
+    const __m256i byte_1_high_table = UTF8_TABLE(
+        // ASCII first
+        B(UTF8_TOO_LONG), B(UTF8_TOO_LONG), B(UTF8_TOO_LONG), B(UTF8_TOO_LONG),
+        B(UTF8_TOO_LONG), B(UTF8_TOO_LONG), B(UTF8_TOO_LONG), B(UTF8_TOO_LONG),
+        // Continuation first
+        B(UTF8_TWO_CONTS), B(UTF8_TWO_CONTS), B(UTF8_TWO_CONTS), B(UTF8_TWO_CONTS),
+        // 2, 2, 3 and 4 byte leads
+        B(UTF8_TOO_SHORT | UTF8_OVERLONG_2),
+        B(UTF8_TOO_SHORT),
+        B(UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE),
+        B(UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4));
+    const __m256i byte_1_low_table = UTF8_TABLE(
+        B(UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4),
+        B(UTF8_CARRY | UTF8_OVERLONG_2),
+        B(UTF8_CARRY),
+        B(UTF8_CARRY),
+        B(UTF8_CARRY | UTF8_TOO_LARGE),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000),
+        B(UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000));
+    const __m256i byte_2_high_table = UTF8_TABLE(
+        // ASCII second
+        B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT),
+        B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT),
+        // Continuation second: 1000____, 1001____, 101_____
+        B(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4),
+        B(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE),
+        B(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+        B(UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE),
+        // Lead second
+        B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT), B(UTF8_TOO_SHORT));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    // Bytes that a lead near the end of the block still needs to follow it
+    const __m256i incomplete_limit = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        B(0xf0 - 1), B(0xe0 - 1), B(0xc0 - 1));
+
+    __m256i error = _mm256_setzero_si256();
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    // The zero padding after the last block catches a sequence cut short
+    for (size_t i = 0; i < size + 32; i += 32) {
+        __m256i input = _mm256_setzero_si256();
+        if (i + 32 <= size) {
+            input = _mm256_loadu_si256((const __m256i *) (text + i));
+        } else if (i < size) {
+            char tail[32] = {0};
+            for (size_t j = 0; i + j < size; ++j) tail[j] = text[i + j];
+            input = _mm256_loadu_si256((const __m256i *) tail);
+        }
+
+        if (_mm256_movemask_epi8(input) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+        } else {
+            const __m256i prev1 = utf8_prev_avx2(input, prev_input, 1);
+            const __m256i byte_1_high = _mm256_shuffle_epi8(byte_1_high_table, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+            const __m256i byte_1_low = _mm256_shuffle_epi8(byte_1_low_table, _mm256_and_si256(prev1, nibble));
+            const __m256i byte_2_high = _mm256_shuffle_epi8(byte_2_high_table, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+            const __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+            // Only 111_____ 2 back and 1111____ 3 back stay >= 0x80
+            const __m256i third = _mm256_subs_epu8(utf8_prev_avx2(input, prev_input, 2), _mm256_set1_epi8(B(0xe0 - 0x80)));
+            const __m256i fourth = _mm256_subs_epu8(utf8_prev_avx2(input, prev_input, 3), _mm256_set1_epi8(B(0xf0 - 0x80)));
+            const __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(B(0x80)));
+            error = _mm256_or_si256(error, _mm256_xor_si256(must_continue, special));
+            prev_incomplete = _mm256_subs_epu8(input, incomplete_limit);
+        }
+        prev_input = input;
+    }
+    return _mm256_testz_si256(error, error);
+}
+
+#undef B
+#undef UTF8_TABLE
+#endif // UTF8_X86
+
+static Mask_Func continuation_mask = NULL;
+static Mask_Func high_mask = NULL;
+// Whole text check, if there is a fast one
+static Valid_Func valid = NULL;
+
+static void utf8_pick_masks(void)
+{
+    if (continuation_mask != NULL) {
+        return;
+    }
+
+    Mask_Func continuation = continuation_mask_scalar;
+    Mask_Func high = high_mask_scalar;
+#ifdef UTF8_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        continuation = continuation_mask_avx2;
+        high = high_mask_avx2;
+        valid = utf8_valid_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        continuation = continuation_mask_sse2;
+        high = high_mask_sse2;
+    }
+#endif
+    // First called from line_loader_start, before its thread exists
+    high_mask = high;
+    continuation_mask = continuation;
+}
+
+// Size of the character at `text`, which starts one: its first byte and
+// the continuation bytes it takes. A continuation byte that starts a
+// character is alone, and so is every continuation byte right after it.
+size_t utf8_next(const char *text, size_t size)
+{
+    assert(size > 0);
+    size_t n = 1;
+    if (UTF8_IS_CONTINUATION(text[0])) {
+        return n;
+    }
+    while (n < size && n < UTF8_MAX_SIZE && UTF8_IS_CONTINUATION(text[n])) {
+        n += 1;
+    }
+    return n;
+}
+
+// Size of the well-formed sequence at the start of `text`, or 0 if it
+// is overlong, a surrogate, past U+10FFFF or cut short
+static size_t utf8_sequence_size(const unsigned char *text, size_t size)
+{
+    const unsigned char lead = text[0];
+    if (lead < 0x80) return 1;
+    if (lead < 0xc2 || lead > 0xf4 || size < 2) return 0;
+
+    size_t n = 0;
+    unsigned char low = 0x80;
+    unsigned char high = 0xbf;
+    if (lead < 0xe0) {
+        n = 2;
+    } else if (lead < 0xf0) {
+        n = 3;
+        if (lead == 0xe0) low = 0xa0;
+        if (lead == 0xed) high = 0x9f;
+    } else {
+        n = 4;
+        if (lead == 0xf0) low = 0x90;
+        if (lead == 0xf4) high = 0x8f;
+    }
+
+    if (text[1] < low || text[1] > high || size < n) return 0;
+    for (size_t i = 2; i < n; ++i) {
+        if (!UTF8_IS_CONTINUATION(text[i])) return 0;
+    }
+    return n;
+}
+
+// Codepoint of one character as split by utf8_next
+uint32_t utf8_decode(const char *text, size_t size)
+{
+    const unsigned char *s = (const unsigned char *) text;
+    if (size == 0 || utf8_sequence_size(s, size) != size) {
+        return UTF8_REPLACEMENT;
+    }
+
+    switch (size) {
+    case 1:  return s[0];
+    case 2:  return (uint32_t) (s[0] & 0x1f) << 6 | (s[1] & 0x3f);
+    case 3:  return (uint32_t) (s[0] & 0x0f) << 12 | (uint32_t) (s[1] & 0x3f) << 6 | (s[2] & 0x3f);
+    default: return (uint32_t) (s[0] & 0x07) << 18 | (uint32_t) (s[1] & 0x3f) << 12 | (uint32_t) (s[2] & 0x3f) << 6 | (s[3] & 0x3f);
+    }
+}
+
+// Whether the byte `c` starts a character after `*run` continuation
+// bytes, and the run after it
+static bool utf8_step(char c, size_t *run)
+{
+    if (!UTF8_IS_CONTINUATION(c)) {
+        *run = 0;
+        return true;
+    }
+    const bool start = *run == UTF8_MAX_CONTINUATIONS;
+    if (!start) *run += 1;
+    return start;
+}
+
+// Starts of a 64 byte block with continuation bytes `cont`: the other
+// bytes, and continuation bytes with 3 more right before them
+static uint64_t utf8_start_mask(uint64_t cont, size_t *run)
+{
+    // The run before the block, as the top bits of the block before it
+    const uint64_t before = *run == 0 ? 0 : ~0ull << (64 - *run);
+    const uint64_t stray = cont &
+        (cont << 1 | before >> 63) &
+        (cont << 2 | before >> 62) &
+        (cont << 3 | before >> 61);
+
+    const uint64_t others = ~cont;
+    if (others == 0) {
+        *run = UTF8_MAX_CONTINUATIONS;
+    } else {
+        const size_t trailing = __builtin_clzll(others);
+        *run = trailing < UTF8_MAX_CONTINUATIONS ? trailing : UTF8_MAX_CONTINUATIONS;
+    }
+    return others | stray;
+}
+
+// Number of bytes in `text` that start a character
+size_t utf8_count_starts(const char *text, size_t size, size_t *run)
+{
+    utf8_pick_masks();
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        count += __builtin_popcountll(utf8_start_mask(continuation_mask(text + i), run));
+    }
+    for (; i < size; ++i) {
+        count += utf8_step(text[i], run);
+    }
+    return count;
+}
+
+// Offset of the start byte after `*n` others in `text`. If there are
+// not that many, returns `size` with the starts passed taken off `*n`
+// and `*run` set, so a search can go on in the next piece of text.
+size_t utf8_find_start(const char *text, size_t size, size_t *n, size_t *run)
+{
+    utf8_pick_masks();
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        uint64_t starts = utf8_start_mask(continuation_mask(text + i), run);
+        const size_t count = __builtin_popcountll(starts);
+        if (*n < count) {
+            for (; *n > 0; *n -= 1) {
+                starts &= starts - 1;
+            }
+            return i + __builtin_ctzll(starts);
+        }
+        *n -= count;
+    }
+    for (; i < size; ++i) {
+        if (utf8_step(text[i], run)) {
+            if (*n == 0) return i;
+            *n -= 1;
+        }
+    }
+    return size;
+}
+
+bool utf8_is_ascii(const char *text, size_t size)
+{
+    utf8_pick_masks();
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        if (high_mask(text + i)) return false;
+    }
+    for (; i < size; ++i) {
+        if ((unsigned char) text[i] >= 0x80) return false;
+    }
+    return true;
+}
+
+// Number of characters in `text` that are not well-formed UTF-8, with
+// the offset of the first in `*first_error`. Valid text is checked with
+// SIMD where there is support; otherwise, or to count the errors, ASCII
+// runs are skipped 64 bytes at a time and only the blocks with other
+// bytes are decoded.
+size_t utf8_validate(const char *text, size_t size, size_t *first_error)
+{
+    utf8_pick_masks();
+    if (valid && valid(text, size)) {
+        return 0;
+    }
+
+    size_t errors = 0;
+    size_t i = 0;
+    while (i < size) {
+        if (i + 64 <= size && high_mask(text + i) == 0) {
+            i += 64;
+            continue;
+        }
+
+        const size_t block_end = i + 64 < size ? i + 64 : size;
+        while (i < block_end) {
+            const size_t n = utf8_next(text + i, size - i);
+            if (utf8_sequence_size((const unsigned char *) text + i, n) != n) {
+                if (errors == 0 && first_error) *first_error = i;
+                errors += 1;
+            }
+            i += n;
+        }
+    }
+    return errors;
+}
@@ -0,0 +1,31 @@
+#ifndef UTF8_H_
+#define UTF8_H_
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UTF8_REPLACEMENT 0xfffd
+#define UTF8_IS_CONTINUATION(c) (((unsigned char) (c) & 0xc0) == 0x80)
+#define UTF8_MAX_SIZE 4
+#define UTF8_MAX_CONTINUATIONS (UTF8_MAX_SIZE - 1)
+
+// Text is split into characters at every byte that is not a continuation
+// byte (10xxxxxx), which takes up to 3 continuation bytes after it. Any
+// other continuation byte, such as one at the start of the text or the
+// 4th after another byte, is a character of its own. A character that is
+// not exactly one well-formed UTF-8 sequence still takes one column and
+// decodes to UTF8_REPLACEMENT, so invalid text can be edited too.
+//
+// So whether a byte starts a character depends on the 3 bytes before it.
+// Functions that look at part of a text take `run`, the number of
+// continuation bytes right before it up to UTF8_MAX_CONTINUATIONS, which
+// is also its value at the start of the text. They leave it set for the
+// text that follows.
+size_t utf8_next(const char *text, size_t size);
+uint32_t utf8_decode(const char *text, size_t size);
+size_t utf8_count_starts(const char *text, size_t size, size_t *run);
+size_t utf8_find_start(const char *text, size_t size, size_t *n, size_t *run);
+bool utf8_is_ascii(const char *text, size_t size);
+size_t utf8_validate(const char *text, size_t size, size_t *first_error);
+
+#endif // UTF8_H_